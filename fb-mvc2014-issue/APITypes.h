@@ -20,6 +20,8 @@ Copyright 2009 Richard Bateman, Firebreath development team
 #include <vector>
 #include <map>
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
 #include <functional>
 #include <memory>
 #include <cstdint>
@@ -89,6 +91,24 @@ namespace FB
 	////////////////////////////////////////////////////////////////////////////////////////////////////
 	using StringSet = std::set < std::string >;
 
+	struct VariantHash;
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// @typedef    FB::VariantSet
+	///
+	/// @brief  Defines an alias representing a hash set of variants.
+	/// @see FB::variant::operator==()
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	using VariantSet = std::unordered_set < variant, VariantHash >;
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// @typedef    FB::VariantHashMap
+	///
+	/// @brief  Defines an alias representing a hash map from variant to variant.
+	/// @see FB::variant::operator==()
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	using VariantHashMap = std::unordered_map < variant, variant, VariantHash >;
+
 	
 
 
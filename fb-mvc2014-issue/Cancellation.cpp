@@ -0,0 +1,89 @@
+/**********************************************************\
+Created:    Oct 15, 2026
+License:    Dual license model; choose one of two:
+            New BSD License
+            http://www.opensource.org/licenses/bsd-license.php
+            - or -
+            GNU Lesser General Public License, version 2.1
+            http://www.gnu.org/licenses/lgpl-2.1.html
+
+Copyright 2026 the FireBreath Dev Team
+\**********************************************************/
+
+#include "Cancellation.h"
+#include "precompiled_headers.h" // On windows, everything above this line in PCH
+#include <vector>
+
+using namespace FB;
+using namespace FB::detail;
+
+bool cancel_hook::attach(const CancellationToken& token) {
+    m_state = token.m_state;
+    return !m_state || m_state->add(this);
+}
+
+void cancel_hook::detach() {
+    if (m_state) {
+        m_state->remove(this);
+    }
+}
+
+CancellationToken cancel_hook::token() const {
+    return CancellationToken(m_state);
+}
+
+bool cancellation_state::add(cancel_hook* hook) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_cancelled.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    hook->m_prev = nullptr;
+    hook->m_next = m_head;
+    if (m_head) {
+        m_head->m_prev = hook;
+    }
+    m_head = hook;
+    hook->m_linked = true;
+    return true;
+}
+
+void cancellation_state::remove(cancel_hook* hook) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!hook->m_linked) {
+        return;
+    }
+    if (hook->m_prev) {
+        hook->m_prev->m_next = hook->m_next;
+    } else {
+        m_head = hook->m_next;
+    }
+    if (hook->m_next) {
+        hook->m_next->m_prev = hook->m_prev;
+    }
+    hook->m_prev = hook->m_next = nullptr;
+    hook->m_linked = false;
+}
+
+void cancellation_state::cancel() {
+    // Take everything which is still registered under the lock, but reject outside of it: rejecting
+    // runs handlers, which may well create (and register) or drop other stages of the chain
+    std::vector<cancel_hook*> targets;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_cancelled.load(std::memory_order_relaxed)) {
+            return;
+        }
+        m_cancelled.store(true, std::memory_order_release);
+        for (cancel_hook* hook = m_head; hook; hook = hook->m_next) {
+            hook->m_linked = false;
+            if (hook->retain()) {
+                targets.push_back(hook);
+            }
+        }
+        m_head = nullptr;
+    }
+    const std::exception_ptr reason(std::make_exception_ptr(PromiseCancelled()));
+    for (cancel_hook* hook : targets) {
+        hook->cancel(reason);
+    }
+}
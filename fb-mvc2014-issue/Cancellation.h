@@ -0,0 +1,159 @@
+/**********************************************************\
+Created:    Oct 15, 2026
+License:    Dual license model; choose one of two:
+            New BSD License
+            http://www.opensource.org/licenses/bsd-license.php
+            - or -
+            GNU Lesser General Public License, version 2.1
+            http://www.gnu.org/licenses/lgpl-2.1.html
+
+Copyright 2026 the FireBreath Dev Team
+\**********************************************************/
+
+#pragma once
+#ifndef H_FBCANCELLATION
+#define H_FBCANCELLATION
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+namespace FB {
+
+    class CancellationToken;
+
+    /// @brief The exception a Promise is rejected with when its CancellationToken is cancelled
+    class PromiseCancelled : public std::runtime_error
+    {
+    public:
+        PromiseCancelled() : std::runtime_error("Promise cancelled") {}
+    };
+
+    namespace detail {
+        class cancellation_state;
+
+        // Something a CancellationToken has to reach when it is cancelled; in practice the shared
+        // state of a pending FB::Deferred which was created with the token
+        class cancel_hook
+        {
+        public:
+            cancel_hook() : m_prev(nullptr), m_next(nullptr), m_linked(false) {}
+            virtual ~cancel_hook() { detach(); }
+
+            // Registers with token (once); returns false if it has been cancelled already
+            bool attach(const CancellationToken& token);
+            // Makes sure cancel() is not called; the token is still remembered
+            void detach();
+            CancellationToken token() const;
+
+            // Called with the token's lock held: take a reference to the target, or return false if
+            // it is already being destroyed
+            virtual bool retain() = 0;
+            // Called without the lock once retain() returned true: reject the target and drop the
+            // reference retain() took.  May destroy the hook, so it must be the last thing done.
+            virtual void cancel(const std::exception_ptr& reason) = 0;
+
+        private:
+            friend class cancellation_state;
+            cancel_hook(const cancel_hook&) = delete;
+            cancel_hook& operator=(const cancel_hook&) = delete;
+
+            std::shared_ptr<cancellation_state> m_state;
+            cancel_hook* m_prev;
+            cancel_hook* m_next;
+            bool m_linked;              // guarded by the token's lock
+        };
+
+        class cancellation_state
+        {
+        public:
+            cancellation_state() : m_cancelled(false), m_head(nullptr) {}
+
+            bool isCancelled() const { return m_cancelled.load(std::memory_order_acquire); }
+            bool add(cancel_hook* hook);
+            void remove(cancel_hook* hook);
+            void cancel();
+
+        private:
+            std::atomic<bool> m_cancelled;
+            std::mutex m_mutex;
+            cancel_hook* m_head;
+        };
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @class  CancellationToken
+    ///
+    /// @brief  The receiving end of a CancellationSource: lets work find out that its result is no
+    ///         longer wanted.
+    ///
+    /// A Deferred created with a token (see FB::Deferred::Deferred(const CancellationToken&)) is
+    /// rejected with FB::PromiseCancelled as soon as the token is cancelled, if it is still pending.
+    /// The token travels down a chain: Promises created by then, thenPipe, withCancellation and the
+    /// combinators in PromiseCombinators.h carry the token of the Promise they were created from, and
+    /// the handlers of a stage which was cancelled are never called.  Cancelling therefore rejects
+    /// every pending stage of the chain at once, which releases whatever their handlers captured
+    /// and keeps later stages from doing any work.
+    ///
+    /// Cancellation is cooperative: work which is already running is not interrupted, but can poll
+    /// isCancelled() (e.g. via Promise::cancellationToken()) and give up early.
+    ///
+    /// A default constructed token is never cancelled.
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    class CancellationToken
+    {
+    public:
+        CancellationToken() {}
+
+        /// @brief Returns true once the source of this token has been cancelled
+        bool isCancelled() const { return m_state && m_state->isCancelled(); }
+        /// @brief Throws FB::PromiseCancelled if isCancelled()
+        void throwIfCancelled() const {
+            if (isCancelled()) {
+                throw PromiseCancelled();
+            }
+        }
+        /// @brief Returns true if this token belongs to a CancellationSource
+        explicit operator bool() const { return static_cast<bool>(m_state); }
+
+    private:
+        friend class CancellationSource;
+        friend class detail::cancel_hook;
+        explicit CancellationToken(std::shared_ptr<detail::cancellation_state> state) : m_state(std::move(state)) {}
+
+        std::shared_ptr<detail::cancellation_state> m_state;
+    };
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @class  CancellationSource
+    ///
+    /// @brief  Hands out CancellationToken objects and cancels them all at once.
+    ///
+    /// @code
+    ///      FB::CancellationSource source;
+    ///      FB::Deferred<FB::variant> dfd(source.token());
+    ///      dfd.promise().thenPipe<FB::variant>(...).thenPipe<FB::variant>(...);
+    ///      ...
+    ///      source.cancel();     // every stage still pending rejects with FB::PromiseCancelled
+    /// @endcode
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    class CancellationSource
+    {
+    public:
+        CancellationSource() : m_state(std::make_shared<detail::cancellation_state>()) {}
+
+        /// @brief Returns a token which is cancelled when this source is
+        CancellationToken token() const { return CancellationToken(m_state); }
+        /// @brief Cancels all tokens of this source; only the first call does anything
+        void cancel() const { m_state->cancel(); }
+        bool isCancelled() const { return m_state->isCancelled(); }
+
+    private:
+        std::shared_ptr<detail::cancellation_state> m_state;
+    };
+
+}
+
+#endif // H_FBCANCELLATION
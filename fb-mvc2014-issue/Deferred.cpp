@@ -14,9 +14,78 @@ Copyright 2015 Richard Bateman and the FireBreath Dev Team
 
 #include "APITypes.h"
 #include "Deferred.h"
+#include <new>
+#include <vector>
 
 using namespace FB;
+using namespace FB::detail;
 
+namespace {
+    struct SettleQueue {
+        struct Entry {
+            void* state;
+            settle_queue::RunFn run;
+        };
+        // Drained front to back and only cleared once empty, so its capacity is reused from one
+        // resolution to the next
+        std::vector<Entry> entries;
+        std::size_t next = 0;
+        unsigned enabled = 0;       // number of PromiseTrampoline objects on this thread
+        bool draining = false;
+    };
+
+    SettleQueue& localQueue() {
+        static thread_local SettleQueue queue;
+        return queue;
+    }
+}
+
+bool settle_queue::push(void* state, RunFn run) {
+    SettleQueue& queue(localQueue());
+    if (!queue.enabled) {
+        return false;
+    }
+    try {
+        queue.entries.push_back(SettleQueue::Entry{ state, run });
+    } catch (const std::bad_alloc&) {
+        return false;   // the caller runs it right away instead
+    }
+    return true;
+}
+
+void settle_queue::drain() {
+    SettleQueue& queue(localQueue());
+    if (queue.draining) {
+        return;
+    }
+    queue.draining = true;
+    std::exception_ptr error;
+    while (queue.next < queue.entries.size()) {
+        // entries may grow while this one runs, so copy it out rather than keep a reference
+        SettleQueue::Entry entry(queue.entries[queue.next++]);
+        try {
+            entry.run(entry.state);
+        } catch (...) {
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+    queue.entries.clear();
+    queue.next = 0;
+    queue.draining = false;
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void settle_queue::enable() {
+    ++localQueue().enabled;
+}
+
+void settle_queue::disable() {
+    --localQueue().enabled;
+}
 
 
 
@@ -16,9 +16,24 @@ Copyright 2015 Richard Bateman and the FireBreath Dev Team
 #ifndef H_FBDEFERRED
 #define H_FBDEFERRED
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <type_traits>
+#include <boost/intrusive_ptr.hpp>
+#include <boost/optional.hpp>
 #include "APITypes.h"
+#include "Cancellation.h"
+#include "Executor.h"
+#include "Expected.h"
+#include "PromiseStats.h"
+#include "Util/block_cache.h"
 
 namespace FB {
     
@@ -40,6 +55,72 @@ namespace FB {
     template <typename T> 
     class Promise;
 
+    class PromiseTrampoline;
+
+    namespace detail {
+        struct promise_access;
+
+        // Per-thread queue of settled states whose callbacks are still to run; see PromiseTrampoline
+        class settle_queue
+        {
+        public:
+            using RunFn = void (*)(void*);
+
+            // Queues run(state) and returns true if trampolining is on for this thread; nothing runs
+            // the queue until drain() is called
+            static bool push(void* state, RunFn run);
+            // Runs the queue until it is empty, unless this thread is already doing so further up
+            static void drain();
+
+        private:
+            friend class FB::PromiseTrampoline;
+            static void enable();
+            static void disable();
+        };
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @class  PromiseTrampoline
+    ///
+    /// @brief  Turns on trampolined resolution for the current thread for as long as it exists.
+    ///
+    /// Settling a Deferred normally runs its handlers before resolve() or reject() returns.  A
+    /// handler which settles the next Deferred of a chain (as every thenPipe stage does) therefore
+    /// runs that one's handlers from inside its own call, and a chain of a few thousand stages can
+    /// run out of stack.  While a PromiseTrampoline exists on a thread, a Deferred settled there from
+    /// inside a handler only queues its handlers; the outermost resolve() or reject() then runs the
+    /// queue until it is empty, so the depth stays the same however long the chain is.
+    ///
+    /// The price is ordering: a resolve() called from a handler returns before the handlers of that
+    /// Deferred have run, and the handlers of different Deferreds run in the order the Deferreds
+    /// settled (breadth first) rather than nested.  The Promise itself is settled right away, so
+    /// get() and wait() don't block on it; handlers added to it before its turn comes are run with
+    /// the others, in the order they were added.
+    ///
+    /// If a handler throws, the rest of the queue still runs and the first exception is rethrown from
+    /// the outermost resolve() or reject().
+    ///
+    /// Instances may be nested; trampolining stays on until the last one is destroyed.
+    ///
+    /// @code
+    ///      void EventLoop::run() {
+    ///          FB::PromiseTrampoline trampoline;
+    ///          while (waitForEvent()) {
+    ///              dispatch();
+    ///          }
+    ///      }
+    /// @endcode
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    class PromiseTrampoline final
+    {
+    public:
+        PromiseTrampoline() { detail::settle_queue::enable(); }
+        ~PromiseTrampoline() { detail::settle_queue::disable(); }
+
+    private:
+        PromiseTrampoline(const PromiseTrampoline&) = delete;
+        PromiseTrampoline& operator=(const PromiseTrampoline&) = delete;
+    };
     
     ////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief  Resolves or Rejects a Promise object, used to create a new Promise
@@ -52,57 +133,424 @@ namespace FB {
     ////////////////////////////////////////////////////////////////////////////////////////////////////
     template <typename T> 
     class Deferred final { 
-        friend class Promise<T>;
+        template <typename U> friend class Promise;
+        friend struct detail::promise_access;
     public: 
         using type = T;
-        using Callback = std::function<void(T)>;
-        using ErrCallback = std::function<void(std::exception_ptr ep)>;
+        // Move-only, so handlers are never copied once registered.  The value is passed by
+        // reference; it lives in the shared state and is not copied for each handler.
+        using Callback = unique_function<void(const T&)>;
+        using ErrCallback = unique_function<void(std::exception_ptr ep)>;
+        // See Promise::consume
+        using ConsumeCallback = unique_function<void(T&&)>;
         
     private:
-        struct StateData {
-            StateData(T v) : value(v), state(PromiseState::RESOLVED) {}
-            StateData(std::exception_ptr ep) : state(PromiseState::REJECTED), err_ptr(ep) {}
-            StateData() : state(PromiseState::PENDING) {}
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        /// @struct StateData
+        ///
+        /// @brief  State shared by a Deferred and its Promises; safe to use from any number of threads
+        ///         without a lock.
+        ///
+        /// The atomic state word is the only synchronization point.  The first resolve() or reject()
+        /// moves it from PENDING to an internal SETTLING state (any later one is ignored), writes value
+        /// or err_ptr and then publishes RESOLVED or REJECTED.  Neither is written again after that,
+        /// so a thread which has seen a settled state can read them freely.
+        ///
+        /// Callbacks are pushed onto a lock-free stack.  Settling swaps the stack for a "closed" marker
+        /// and runs what it took in the order it was added; once the stack is closed new callbacks
+        /// are called right away on the registering thread.  The first node is built in place inside
+        /// StateData, so a promise with a single continuation (by far the most common case) costs no
+        /// allocation beyond the StateData.
+        ///
+        /// StateData is reference counted intrusively (see StateDataPtr) and its memory comes from a
+        /// per-thread cache of blocks, so building and tearing down a long chain of promises rarely
+        /// reaches the global allocator.
+        ///
+        /// With a PromiseTrampoline on the settling thread the callbacks are queued (together with a
+        /// reference to the state) instead of being run by resolve() or reject() themselves.
+        ///
+        /// The promise_record base is empty unless FB_DEFERRED_INSTRUMENTATION is defined; see
+        /// PromiseStats.h.
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        struct StateData final : detail::promise_record {
+            struct CallbackNode {
+                CallbackNode() : next(nullptr), inPlace(false) {}
+                virtual ~CallbackNode() {}
+                // Called once the state is settled; last is true if no other node runs after this one
+                virtual void run(StateData& state, bool last) = 0;
+
+                CallbackNode* next;
+                bool inPlace;   // built in StateData::firstNode rather than on the heap
+            };
+
+            // Handlers registered with Promise::done, consume or fail; any of them may be empty
+            struct HandlerNode final : CallbackNode {
+                HandlerNode(Callback onResolve, ConsumeCallback onConsume, ErrCallback onReject, const ExecutorPtr& executor)
+                    : onResolve(std::move(onResolve)), onConsume(std::move(onConsume)), onReject(std::move(onReject)), executor(executor) {}
+
+                void run(StateData& state, bool last) override {
+                    if (state.isResolved()) {
+                        if (!onResolve && !onConsume) {
+                            return;
+                        }
+                        if (executor) {
+                            if (onResolve || !last) {
+                                state.markExecutorReader();
+                            }
+                            // keep the state alive rather than copying the value into the task
+                            StateDataPtr keep(&state);
+                            executor->execute([keep, onResolve = std::move(onResolve), onConsume = std::move(onConsume), last]() mutable {
+                                keep->deliver(onResolve, onConsume, last);
+                            });
+                        } else {
+                            state.deliver(onResolve, onConsume, last);
+                        }
+                    } else if (onReject) {
+                        if (executor) {
+                            // only the exception is captured: when a pending state is destroyed it
+                            // rejects itself with no references left, so it can't be kept alive
+                            executor->execute([onReject = std::move(onReject), ep = state.err_ptr]() mutable { onReject(ep); });
+                        } else {
+                            onReject(state.err_ptr);
+                        }
+                    }
+                }
+
+                Callback onResolve;
+                ConsumeCallback onConsume;
+                ErrCallback onReject;
+                ExecutorPtr executor;
+            };
+
+            // A single callable which handles both outcomes: fn(&value, nullptr) or fn(nullptr, err).
+            // Used for the continuations Promise and Deferred create internally, so that whatever
+            // they capture (usually the next Deferred) is captured once rather than by two handlers.
+            template <typename F>
+            struct SettleNode final : CallbackNode {
+                SettleNode(F fn, const ExecutorPtr& executor) : fn(std::move(fn)), executor(executor) {}
+
+                void run(StateData& state, bool) override {
+                    if (state.isResolved()) {
+                        if (executor) {
+                            state.markExecutorReader();
+                            StateDataPtr keep(&state);
+                            executor->execute([keep, fn = std::move(fn)]() mutable { fn(&keep->value, std::exception_ptr()); });
+                        } else {
+                            fn(&state.value, std::exception_ptr());
+                        }
+                    } else {
+                        if (executor) {
+                            executor->execute([fn = std::move(fn), ep = state.err_ptr]() mutable { fn(nullptr, ep); });
+                        } else {
+                            fn(nullptr, state.err_ptr);
+                        }
+                    }
+                }
+
+                F fn;
+                ExecutorPtr executor;
+            };
+
+            // Rejects the state when the CancellationToken it was created with is cancelled
+            struct CancelHook final : detail::cancel_hook {
+                explicit CancelHook(StateData& owner) : owner(owner) {}
+
+                bool retain() override {
+                    unsigned count = owner.refs.load(std::memory_order_relaxed);
+                    do {
+                        if (!count) {
+                            return false;
+                        }
+                    } while (!owner.refs.compare_exchange_weak(count, count + 1, std::memory_order_relaxed));
+                    return true;
+                }
+                void cancel(const std::exception_ptr& reason) override {
+                    StateDataPtr keep(&owner, false);   // adopts the reference from retain()
+                    keep->reject(reason);
+                }
+
+                StateData& owner;
+            };
+
+            // Frees a list of nodes which didn't get to run (e.g. because a callback threw)
+            struct CallbackList {
+                StateData* owner;
+                CallbackNode* head;
+                ~CallbackList() {
+                    while (head) {
+                        CallbackNode* next = head->next;
+                        owner->releaseNode(head);
+                        head = next;
+                    }
+                }
+            };
+
+            static const int SETTLING = -1;
+
+            StateData(T v) : promise_record(false), value(std::move(v)), state(static_cast<int>(PromiseState::RESOLVED)), callbacks(closed()), cancelHook(nullptr), waiter(nullptr), executorReaders(false), firstNodeUsed(false), refs(0) {}
+            StateData(std::exception_ptr ep) : promise_record(false), state(static_cast<int>(PromiseState::REJECTED)), err_ptr(ep), callbacks(closed()), cancelHook(nullptr), waiter(nullptr), executorReaders(false), firstNodeUsed(false), refs(0) {}
+            StateData() : promise_record(true), state(static_cast<int>(PromiseState::PENDING)), callbacks(nullptr), cancelHook(nullptr), waiter(nullptr), executorReaders(false), firstNodeUsed(false), refs(0) {}
             ~StateData() {
-                if (state == PromiseState::PENDING && rejectList.size()) {
-                    reject(std::make_exception_ptr(std::runtime_error("Deferred object destroyed: 1")));
+                if (getState() == PromiseState::PENDING) {
+                    onAbandoned();
+                    if (callbacks.load(std::memory_order_acquire)) {
+                        reject(std::make_exception_ptr(std::runtime_error("Deferred object destroyed: 1")));
+                    }
                 }
+                delete cancelHook;
+                delete waiter.load(std::memory_order_relaxed);
+            }
+            StateData(const StateData&) = delete;
+            StateData& operator=(const StateData&) = delete;
+
+            static void* operator new(std::size_t) {
+                static_assert(alignof(StateData) <= alignof(std::max_align_t), "StateData is over-aligned for block_cache");
+                return detail::block_cache<sizeof(StateData)>::allocate();
             }
-            void resolve(T v) {
-                value = v;
-                state = PromiseState::RESOLVED;
-                rejectList.clear();
-                for (auto fn : resolveList) {
-                    fn(v);
+            static void operator delete(void* p) {
+                detail::block_cache<sizeof(StateData)>::deallocate(p);
+            }
+
+            friend void intrusive_ptr_add_ref(StateData* p) {
+                p->refs.fetch_add(1, std::memory_order_relaxed);
+            }
+            friend void intrusive_ptr_release(StateData* p) {
+                if (p->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    delete p;
                 }
-                resolveList.clear();
+            }
+
+            // Marks a stack which has been taken by the settling thread; never a real node
+            static CallbackNode* closed() {
+                return reinterpret_cast<CallbackNode*>(static_cast<std::uintptr_t>(1));
+            }
+
+            // SETTLING is reported as PENDING, since value / err_ptr may not be written yet
+            PromiseState getState() const {
+                int s = state.load(std::memory_order_acquire);
+                return s == SETTLING ? PromiseState::PENDING : static_cast<PromiseState>(s);
+            }
+            bool isResolved() const {
+                return state.load(std::memory_order_acquire) == static_cast<int>(PromiseState::RESOLVED);
+            }
+
+            // Has the state rejected with FB::PromiseCancelled when token is cancelled; only called
+            // right after construction, before the state is shared
+            void bind(const CancellationToken& token) {
+                if (!token) {
+                    return;
+                }
+                cancelHook = new CancelHook(*this);
+                if (!cancelHook->attach(token)) {
+                    reject(std::make_exception_ptr(PromiseCancelled()));
+                }
+            }
+            CancellationToken cancellationToken() const {
+                return cancelHook ? cancelHook->token() : CancellationToken();
+            }
+
+            void resolve(T&& v) {
+                if (!beginSettle()) {
+                    return;
+                }
+                value = std::move(v);
+                state.store(static_cast<int>(PromiseState::RESOLVED), std::memory_order_release);
+                onSettled(true);
+                scheduleCallbacks();
             }
             void reject(std::exception_ptr ep) {
+                if (!beginSettle()) {
+                    return;
+                }
                 err_ptr = ep;
-                state = PromiseState::REJECTED;
-                resolveList.clear();
-                for (auto fn : rejectList) {
-                    fn(ep);
+                state.store(static_cast<int>(PromiseState::REJECTED), std::memory_order_release);
+                onSettled(false);
+                scheduleCallbacks();
+            }
+
+            // Calls onResolve / onConsume or onReject (any may be empty) once the state is settled, on
+            // executor if there is one; if it already is settled they are called before this returns
+            void addCallbacks(Callback onResolve, ErrCallback onReject, ConsumeCallback onConsume, const ExecutorPtr& executor) {
+                addNode<HandlerNode>(std::move(onResolve), std::move(onConsume), std::move(onReject), executor);
+            }
+            // Calls fn(&value, nullptr) or fn(nullptr, err) once the state is settled; see SettleNode
+            template <typename F>
+            void addSettle(F&& fn, const ExecutorPtr& executor = nullptr) {
+                addNode<SettleNode<typename std::decay<F>::type>>(std::forward<F>(fn), executor);
+            }
+
+            // What Promise::wait() sleeps on.  The first wait on the state makes it, together with
+            // the continuation which wakes it; every later one (e.g. wait_for() called in a loop)
+            // shares them, so waiting adds nothing more to the state however often it times out.
+            struct Waiter {
+                Waiter() : settled(false) {}
+                std::mutex mutex;
+                std::condition_variable cv;
+                bool settled;
+            };
+            Waiter& getWaiter() {
+                Waiter* current = waiter.load(std::memory_order_acquire);
+                if (!current) {
+                    std::unique_ptr<Waiter> fresh(new Waiter);
+                    if (waiter.compare_exchange_strong(current, fresh.get(), std::memory_order_acq_rel, std::memory_order_acquire)) {
+                        current = fresh.release();
+                        // the state owns the Waiter, and is alive for as long as the callback can run
+                        addSettle([current](const T*, const std::exception_ptr&) {
+                            std::lock_guard<std::mutex> lock(current->mutex);
+                            current->settled = true;
+                            current->cv.notify_all();
+                        });
+                    }
                 }
-                rejectList.clear();
+                return *current;
             }
+
             T value;
-            PromiseState state;
+            std::atomic<int> state;
             std::exception_ptr err_ptr;
-            
-            std::vector<Callback> resolveList;
-            std::vector<ErrCallback> rejectList;
+            std::atomic<CallbackNode*> callbacks;
+            CancelHook* cancelHook;     // only if created with a CancellationToken
+            std::atomic<Waiter*> waiter;    // see getWaiter()
+
+        private:
+            using FirstNodeStorage = typename std::aligned_storage<sizeof(HandlerNode), std::alignment_of<HandlerNode>::value>::type;
+
+            // Set once a task which reads value has been posted to an executor; from then on value
+            // may be read at any time, so a consumer is never given it to move from
+            std::atomic<bool> executorReaders;
+            FirstNodeStorage firstNode;
+            std::atomic<bool> firstNodeUsed;
+            std::atomic<unsigned> refs;
+
+            template <typename Node, typename... Args>
+            void addNode(Args&&... args) {
+                CallbackNode* head = callbacks.load(std::memory_order_acquire);
+                if (head == closed()) {
+                    // already settled (and published, since the stack is closed after that)
+                    Node node(std::forward<Args>(args)...);
+                    node.run(*this, true);
+                    return;
+                }
+                CallbackNode* node = makeNode<Node>(std::integral_constant<bool,
+                    sizeof(Node) <= sizeof(FirstNodeStorage) &&
+                    std::alignment_of<FirstNodeStorage>::value % std::alignment_of<Node>::value == 0>(),
+                    std::forward<Args>(args)...);
+                do {
+                    node->next = head;
+                    if (callbacks.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_acquire)) {
+                        return;
+                    }
+                } while (head != closed());
+                node->next = nullptr;
+                CallbackList list = { this, node };
+                node->run(*this, true);
+            }
+
+            template <typename Node, typename... Args>
+            CallbackNode* makeNode(std::true_type, Args&&... args) {
+                if (firstNodeUsed.exchange(true, std::memory_order_relaxed)) {
+                    return makeNode<Node>(std::false_type(), std::forward<Args>(args)...);
+                }
+                Node* node = new (&firstNode) Node(std::forward<Args>(args)...);
+                node->inPlace = true;
+                return node;
+            }
+            template <typename Node, typename... Args>
+            CallbackNode* makeNode(std::false_type, Args&&... args) {
+                return new Node(std::forward<Args>(args)...);
+            }
+
+            // Drops a node once it has run (or will never run)
+            void releaseNode(CallbackNode* node) {
+                if (node->inPlace) {
+                    node->~CallbackNode();
+                } else {
+                    delete node;
+                }
+            }
+
+            bool beginSettle() {
+                int expected = static_cast<int>(PromiseState::PENDING);
+                if (!state.compare_exchange_strong(expected, SETTLING, std::memory_order_acquire, std::memory_order_relaxed)) {
+                    return false;
+                }
+                if (cancelHook) {
+                    // nothing left to cancel; keeps the token from holding on to settled states
+                    cancelHook->detach();
+                }
+                return true;
+            }
+
+            void markExecutorReader() {
+                executorReaders.store(true, std::memory_order_release);
+            }
+
+            // Hands the resolved value to a done() or consume() handler; a consumer gets the value
+            // itself only if nothing runs after it and no task posted to an executor may still read it
+            void deliver(Callback& onResolve, ConsumeCallback& onConsume, bool last) {
+                if (onResolve) {
+                    onResolve(value);
+                } else if (onConsume) {
+                    if (last && !executorReaders.load(std::memory_order_acquire)) {
+                        onConsume(std::move(value));
+                    } else {
+                        T copy(value);
+                        onConsume(std::move(copy));
+                    }
+                }
+            }
+
+            // Runs the callbacks now, or queues them if this thread trampolines; a state which is being
+            // destroyed has no references left to keep it alive in the queue, so always runs them now
+            void scheduleCallbacks() {
+                if (refs.load(std::memory_order_relaxed) && detail::settle_queue::push(this, &StateData::runQueued)) {
+                    intrusive_ptr_add_ref(this);    // dropped by runQueued; nothing runs the queue before drain()
+                    detail::settle_queue::drain();
+                } else {
+                    runCallbacks();
+                }
+            }
+            static void runQueued(void* p) {
+                StateDataPtr keep(static_cast<StateData*>(p), false);
+                keep->runCallbacks();
+            }
+
+            void runCallbacks() {
+                // the stack is newest first; reverse it so callbacks run in the order they were added
+                CallbackList list = { this, nullptr };
+                CallbackNode* node = callbacks.exchange(closed(), std::memory_order_acq_rel);
+                while (node) {
+                    CallbackNode* next = node->next;
+                    node->next = list.head;
+                    list.head = node;
+                    node = next;
+                }
+                while (list.head) {
+                    CallbackList current = { this, list.head };
+                    list.head = list.head->next;
+                    current.head->next = nullptr;
+                    current.head->run(*this, list.head == nullptr);
+                }
+            }
         };
-        using StateDataPtr = std::shared_ptr<StateData>;
+        // Intrusive, so a StateData and its count are one allocation and a pointer is one word
+        using StateDataPtr = boost::intrusive_ptr<StateData>;
         
         StateDataPtr m_data;
     public:
         /// @brief Instantiates a Deferred with a Promise which is already resolved to v
-        Deferred(T v) : m_data(std::make_shared<StateData>(v)) {}
+        Deferred(T v) : m_data(new StateData(std::move(v))) {}
         /// @brief Instantiates a Deferred with a Promise which is already rejected with e
-        Deferred(std::exception_ptr ep) : m_data(std::make_shared<StateData>(ep)) {}
+        Deferred(std::exception_ptr ep) : m_data(new StateData(ep)) {}
         /// @brief Instantiates a Deferred object with a pending Promise
-        Deferred() : m_data(std::make_shared<StateData>()) {}
+        Deferred() : m_data(new StateData()) {}
+        /// @brief Instantiates a Deferred object with a pending Promise which is rejected with
+        /// FB::PromiseCancelled if token is cancelled before it is settled
+        ///
+        /// Promises chained from it carry the same token; see FB::CancellationToken
+        explicit Deferred(const CancellationToken& token) : m_data(new StateData()) {
+            m_data->bind(token);
+        }
         /// @brief Creates an object with the shared data from the rh object (move)
         Deferred(Deferred<T> &&rh) : m_data(std::move(rh.m_data)) {} // Move constructor
         /// @brief Creates an object with the shared data from the rh object (copy)
@@ -126,51 +574,171 @@ namespace FB {
         /// @brief Returns a FB::Promise<T> object controlled by this FB::Deferred
         /// object
         Promise<T> promise() const { return Promise<T>(m_data); }
+
+        /// @brief Returns the token this Deferred was created with (or inherited through a chain);
+        /// the code which produces the value can poll it to stop early
+        CancellationToken cancellationToken() const { return m_data->cancellationToken(); }
         
         /// @brief invalidates this Deferred; if the object is still pending, reject
         /// it
         void invalidate() const {
-            if (m_data->state == PromiseState::PENDING) {
+            if (m_data->getState() == PromiseState::PENDING) {
+                m_data->onInvalidated();
                 reject(std::make_exception_ptr(std::runtime_error("Deferred object destroyed: 2")));
             }
         }
         
         /// @brief Resolves all associated Promise objects to v
-        void resolve(T v) const { m_data->resolve(v); }
+        ///
+        /// v is moved into the shared state; handlers get a reference to it from there
+        void resolve(T v) const { m_data->resolve(std::move(v)); }
         /// @brief All associated Promise objects with resolve or reject along with v
         void resolve(Promise<T> v) const {
+            if (!v.isValid()) {
+                throw std::runtime_error("Promise invalid");
+            }
+            if (v.m_ready) {
+                m_data->resolve(std::move(*v.m_ready));
+                return;
+            }
             Deferred<T> dfd(*this);
-            auto onDone = [dfd](T resV) { dfd.resolve(resV); };
-            auto onFail = [dfd](std::exception_ptr e) { dfd.reject(e); };
-            v.done(onDone, onFail);
+            v.m_data->addSettle([dfd](const T* resV, const std::exception_ptr& e) {
+                if (resV) {
+                    dfd.resolve(*resV);
+                } else {
+                    dfd.reject(e);
+                }
+            });
         }
         /// @brief Rejects all associated Promise objects with e
         void reject(std::exception_ptr ep) const { m_data->reject(ep); }
+        /// @brief Resolves or rejects all associated Promise objects, depending on what result holds;
+        /// nothing is thrown either way
+        void settle(Expected<T> result) const {
+            if (result.hasValue()) {
+                m_data->resolve(std::move(result).value());
+            } else {
+                m_data->reject(result.error());
+            }
+        }
     };
+
+    namespace detail {
+        // Passes what a thenPipe handler returned on to dfd: an FB::Expected settles it right away,
+        // anything else has to convert to a Promise<T>, which dfd then follows
+        template <typename T>
+        void pipe_result(const Deferred<T>& dfd, Expected<T>&& result) {
+            dfd.settle(std::move(result));
+        }
+        template <typename T, typename R>
+        void pipe_result(const Deferred<T>& dfd, R&& result) {
+            Promise<T> res = std::forward<R>(result);
+            dfd.resolve(res);
+        }
+
+        // What Promise::convert_cast does to the value: a single FB::variant conversion, straight
+        // from the value if it is a variant already.  Containers convert to a Promise (see
+        // variant::convert_cast), which Deferred::resolve then follows.
+        template <typename U>
+        struct promise_converter {
+            static auto convert(const variant& v) -> decltype(v.convert_cast<U>()) {
+                return v.convert_cast<U>();
+            }
+            template <typename T>
+            static auto convert(const T& v) -> decltype(variant(v).template convert_cast<U>()) {
+                return variant(v).template convert_cast<U>();
+            }
+        };
+        template <>
+        struct promise_converter<variant> {
+            template <typename T>
+            static variant convert(const T& v) {
+                return variant(v);
+            }
+        };
+    }
       
     template <typename T> 
     class Promise 
     {
     private:
         friend class Deferred<T>;
+        friend struct detail::promise_access;
         typename Deferred<T>::StateDataPtr m_data;
-        
+        // Holds the value of a Promise which was created already resolved (see Promise(T)) instead of
+        // m_data, so that returning a value which is known right away allocates nothing; a shared
+        // state is only made for it if a handler has to be run on an executor.  Copies of the Promise
+        // each hold their own, and consume() never moves out of it.
+        boost::optional<T> m_ready;
+
+        // Shared state to register handlers with; a new one holding a copy of the value for a ready
+        // Promise.  The Promise must be valid.
+        typename Deferred<T>::StateDataPtr sharedState() const {
+            return m_data ? m_data : typename Deferred<T>::StateDataPtr(new typename Deferred<T>::StateData(*m_ready));
+        }
+        // Calls fn(&value, nullptr) or fn(nullptr, err) once settled, as StateData::addSettle; a ready
+        // Promise calls it right away.  The Promise must be valid.
+        template <typename F>
+        void settleWith(F&& fn, const ExecutorPtr& executor = nullptr) const {
+            if (m_ready && !executor) {
+                fn(m_ready.get_ptr(), std::exception_ptr());
+            } else {
+                sharedState()->addSettle(std::forward<F>(fn), executor);
+            }
+        }
+
+        template <typename U>
+        Promise<U> convertTo(std::true_type) const {
+            return *this;
+        }
+        template <typename U>
+        Promise<U> convertTo(std::false_type) const {
+            if (!isValid()) {
+                return Promise<U>::rejected(std::make_exception_ptr(std::runtime_error("Promise invalid")));
+            }
+            if (m_ready) {
+                try {
+                    return Promise<U>(detail::promise_converter<U>::convert(*m_ready));
+                }
+                catch (...) {
+                    return Promise<U>::rejected(std::current_exception());
+                }
+            }
+            Deferred<U> dfd(m_data->cancellationToken());
+            Promise<U> promise(dfd.promise());
+            m_data->addSettle([dfd](const T* v, const std::exception_ptr& e) {
+                if (!v) {
+                    dfd.reject(e);
+                    return;
+                }
+                try {
+                    dfd.resolve(detail::promise_converter<U>::convert(*v));
+                }
+                catch (...) {
+                    dfd.reject(std::current_exception());
+                }
+            });
+            return promise;
+        }
               
     public:
+        using type = T;
+
         /// @brief Creates an invalid Promise; useful only if you plan to use the
         /// assignment operator later
         Promise() {}
         Promise(const typename Deferred<T>::StateDataPtr data) : m_data(data) {}
         /// @brief Creates a Promise object using shared state from Promise rh (move)
-        Promise(Promise &&rh) : m_data(std::move(rh.m_data)) {} // Move constructor
+        Promise(Promise &&rh) : m_data(std::move(rh.m_data)), m_ready(std::move(rh.m_ready)) { rh.m_ready = boost::none; } // Move constructor
         /// @brief Creates a Promise object using shared state from Promise rh (copy)
-        Promise(const Promise<T> &rh) : m_data(rh.m_data) {} // Copy constructor
+        ///
+        /// A pre-resolved Promise has no shared state; copying one copies its value.
+        Promise(const Promise<T> &rh) : m_data(rh.m_data), m_ready(rh.m_ready) {} // Copy constructor
         /// @brief The only valid way to create a Promise without a Deferred, creates
         /// a pre-resolved Promise
-        Promise(T v) {
-            Deferred<T> dfd{ v };
-            m_data = dfd.promise().m_data;
-        }
+        ///
+        /// The value is kept in the Promise itself; no shared state is allocated for it.
+        Promise(T v) : m_ready(std::move(v)) {}
         
         /// @brief Assigns rh to this Promise, assuming all shared state from rh and
         /// discarding any current state
@@ -179,15 +747,34 @@ namespace FB {
         /// or Deferred object which exists with that shared state
         Promise<T> &operator=(const Promise<T> &rh) {
             m_data = rh.m_data;
+            m_ready = rh.m_ready;
             return *this;
         }
         Promise<T> &operator=(const Promise<T> &&rh) {
             m_data = std::move(rh.m_data);
+            m_ready = std::move(rh.m_ready);
             return *this;
         }
         
         /// @brief returns true if this is a valid Promise
-        bool isValid() const { return static_cast<bool>(m_data); }
+        bool isValid() const { return m_data || m_ready; }
+
+        /// @brief Returns the CancellationToken this Promise carries, if any; see FB::CancellationToken
+        CancellationToken cancellationToken() const {
+            return m_data ? m_data->cancellationToken() : CancellationToken();
+        }
+        /// @brief Returns a Promise which settles like this one, unless token is cancelled first, in
+        /// which case it rejects with FB::PromiseCancelled
+        ///
+        /// Promises chained from the result carry token, so cancelling it stops the rest of the chain.
+        Promise<T> withCancellation(const CancellationToken& token) const {
+            if (!isValid()) {
+                return rejected(std::make_exception_ptr(std::runtime_error("Promise invalid")));
+            }
+            Deferred<T> dfd(token);
+            dfd.resolve(*this);
+            return dfd.promise();
+        }
         
        
         
@@ -197,10 +784,13 @@ namespace FB {
         /// which would succeed with a convert_cast. If an exception is thrown during conversion
         /// the returned Promise object will be rejected with that exception
         ///
+        /// The conversion runs once, when this Promise resolves, directly on its value; converting
+        /// to the same type just returns this Promise.
+        ///
         /// @return a Promise of the new type which will resolve after the original Promise resolves and a FB::variant::convert_cast succeeds
         template <typename U> 
-        Promise<U> convert_cast() { 
-            return Promise<U>(*this); 
+        Promise<U> convert_cast() const { 
+            return convertTo<U>(std::is_same<T, U>()); 
         }
         
         /// @brief Returns a Promise object which is already rejected
@@ -213,6 +803,57 @@ namespace FB {
         /// @brief Invalidates the Promise object
         void invalidate() { 
             m_data.reset(); 
+            m_ready = boost::none;
+        }
+        
+        /// @brief Blocks the calling thread until the Promise is resolved or rejected and returns
+        /// which of the two it was
+        ///
+        /// This is meant for bridging into synchronous code on a worker thread.  Never call it on a
+        /// thread which the Promise is waiting on (e.g. the main thread, when the value is delivered
+        /// by a call posted back to it): it would never return.  Nothing is allocated unless the
+        /// Promise is still pending; then the thread sleeps on a condition variable until the
+        /// Promise is settled.
+        PromiseState wait() const {
+            if (!isValid()) {
+                throw std::runtime_error("Promise invalid");
+            }
+            if (m_ready) {
+                return PromiseState::RESOLVED;
+            }
+            if (m_data->getState() == PromiseState::PENDING) {
+                typename Deferred<T>::StateData::Waiter& waiter(m_data->getWaiter());
+                std::unique_lock<std::mutex> lock(waiter.mutex);
+                waiter.cv.wait(lock, [&waiter]() { return waiter.settled; });
+            }
+            return m_data->getState();
+        }
+        /// @brief Like wait(), but gives up after timeout; returns PromiseState::PENDING if the
+        /// Promise was not settled by then
+        template <typename Rep, typename Period>
+        PromiseState wait_for(const std::chrono::duration<Rep, Period>& timeout) const {
+            if (!isValid()) {
+                throw std::runtime_error("Promise invalid");
+            }
+            if (m_ready) {
+                return PromiseState::RESOLVED;
+            }
+            if (m_data->getState() == PromiseState::PENDING) {
+                typename Deferred<T>::StateData::Waiter& waiter(m_data->getWaiter());
+                std::unique_lock<std::mutex> lock(waiter.mutex);
+                waiter.cv.wait_for(lock, timeout, [&waiter]() { return waiter.settled; });
+            }
+            return m_data->getState();
+        }
+        /// @brief Waits for the Promise (see wait()) and returns the value it resolved to, or throws
+        /// the exception it was rejected with
+        ///
+        /// The reference is valid for as long as this Promise (or a copy of it) is.
+        const T& get() const {
+            if (wait() == PromiseState::REJECTED) {
+                std::rethrow_exception(m_data->err_ptr);
+            }
+            return m_ready ? *m_ready : m_data->value;
         }
         
         /// @brief Accepts a Success handler and a Fail handler, returns a new
@@ -223,13 +864,44 @@ namespace FB {
         /// cbSuccess or cbFail can be nullptr if only one is desired. Often a lambda expression may
         /// be appropriate for one or both of these Callable types
         ///
-        /// @param cbSuccess nullptr or any Callable target accepting one parameter of type T and returning a value of type Uout
+        /// If cbFail is nullptr a rejection is passed on to the returned Promise; if cbSuccess is nullptr
+        /// the returned Promise is rejected when this one resolves, since there is no value for it.
+        /// Anything a handler throws rejects the returned Promise.
+        ///
+        /// @param cbSuccess nullptr or any Callable target accepting one parameter of type const T& and returning a value of type Uout
         /// @param cbFail    nullptr or any Callable target accepting one parameter of type std::exception and returning a value of type Uout
+        /// @param executor  where to run the handlers; nullptr runs them on the thread which resolves this Promise
         ///
         /// @see http://en.cppreference.com/w/cpp/utility/functional/function
         template <typename Uout>
-        Promise<Uout> then(std::function<Uout(T)> cbSuccess, std::function<Uout(std::exception_ptr)> cbFail = nullptr) const {
-            return _doPromiseThen<Uout, T>(*this, cbSuccess, cbFail);
+        Promise<Uout> then(unique_function<Uout(const T&)> cbSuccess, unique_function<Uout(std::exception_ptr)> cbFail = nullptr, const ExecutorPtr& executor = nullptr) const {
+            if (!isValid()) {
+                return Promise<Uout>::rejected(std::make_exception_ptr(std::runtime_error("Promise invalid")));
+            }
+            Deferred<Uout> dfd(cancellationToken());
+            Promise<Uout> promise(dfd.promise());
+            settleWith([dfd = std::move(dfd), cbSuccess = std::move(cbSuccess), cbFail = std::move(cbFail)](const T* v, const std::exception_ptr& e) mutable {
+                if (dfd.m_data->getState() != PromiseState::PENDING) {
+                    return;
+                }
+                try {
+                    if (!v) {
+                        if (cbFail) {
+                            dfd.resolve(cbFail(e));
+                        } else {
+                            dfd.reject(e);
+                        }
+                    } else if (cbSuccess) {
+                        dfd.resolve(cbSuccess(*v));
+                    } else {
+                        dfd.reject(std::make_exception_ptr(std::runtime_error("Promise::then: no success handler")));
+                    }
+                }
+                catch (...) {
+                    dfd.reject(std::current_exception());
+                }
+            }, executor);
+            return promise;
         }
         
         /// @brief Accepts a Success handler and a Fail handler, returns a new
@@ -242,116 +914,165 @@ namespace FB {
         /// in some very powerful ways.  Often a lambad expression may be appropriate for one or both
         /// of these Callable types
         ///
+        /// The returned Promise carries the CancellationToken of this one, if any; once that is
+        /// cancelled it rejects with FB::PromiseCancelled and the handlers are not called.
+        ///
+        /// A handler may also return an FB::Expected<Uout>, which settles the returned Promise right
+        /// away; that is the way to fail without throwing.  Anything a handler throws rejects the
+        /// returned Promise.
+        ///
         /// @param cbSuccess nullptr or any Callable target accepting one parameter of type T and returning a Promise of type Uout
         /// @param cbFail    nullptr or any Callable target accepting one parameter of type std::exception and returning a Promise of type Uout
+        /// @param executor  where to run the handlers; nullptr runs them on the thread which resolves this Promise
         ///
         /// @see http://en.cppreference.com/w/cpp/utility/functional/function
         template <typename Uout, typename Success>
-        Promise<Uout> thenPipe(Success cbSuccess) const {
-            if (!m_data) {
+        Promise<Uout> thenPipe(Success cbSuccess, const ExecutorPtr& executor = nullptr) const {
+            if (!isValid()) {
                 return Promise<Uout>::rejected(std::make_exception_ptr(std::runtime_error("Promise invalid")));
             }
-            Deferred<Uout> dfd;
-            auto onDone = [ dfd, cbSuccess ](T v)->void {
+            Deferred<Uout> dfd(cancellationToken());
+            Promise<Uout> promise(dfd.promise());
+            // one continuation for both outcomes, so dfd is captured once
+            settleWith([dfd = std::move(dfd), cbSuccess](const T* v, const std::exception_ptr& e1)->void {
+                if (dfd.m_data->getState() != PromiseState::PENDING) {
+                    // cancelled; nobody wants the result any more
+                    return;
+                }
+                if (!v) {
+                    dfd.reject(e1);
+                    return;
+                }
                 try {
-					Promise<Uout> res = cbSuccess(v);
-                    auto onDone2 = [dfd](Uout v) { dfd.resolve(v); };
-                    auto onFail2 = [dfd](std::exception_ptr e) { dfd.reject(e); };
-                    res.done(onDone2, onFail2);
+                    detail::pipe_result(dfd, cbSuccess(*v));
                 }
-                catch (std::exception e) {
-                    auto ep = std::current_exception();
-                    dfd.reject(ep);
+                catch (...) {
+                    dfd.reject(std::current_exception());
                 }
-            };
-            
-            auto onFail = [dfd](std::exception_ptr e1)->void {
-                dfd.reject(e1);
-            };
-            done(onDone, onFail);
+            }, executor);
 
-            return dfd.promise();
+            return promise;
         }
 
-		template <typename Uout, typename Success, typename Fail>
-		Promise<Uout> thenPipe(Success cbSuccess, Fail cbFail) const {
-			if (!m_data) {
+		template <typename Uout, typename Success, typename Fail,
+			typename = typename std::enable_if<!std::is_convertible<Fail, ExecutorPtr>::value>::type>
+		Promise<Uout> thenPipe(Success cbSuccess, Fail cbFail, const ExecutorPtr& executor = nullptr) const {
+			if (!isValid()) {
 				return Promise<Uout>::rejected(std::make_exception_ptr(std::runtime_error("Promise invalid")));
 			}
-			Deferred<Uout> dfd;
-			auto onDone = [dfd, cbSuccess](T v)->void {
-				try {
-					Promise<Uout> res = cbSuccess(v);
-					auto onDone2 = [dfd](Uout v) { dfd.resolve(v); };
-					auto onFail2 = [dfd](std::exception_ptr e) { dfd.reject(e); };
-					res.done(onDone2, onFail2);
-				}
-				catch (std::exception e) {
-					auto ep = std::current_exception();
-					dfd.reject(ep);
+			Deferred<Uout> dfd(cancellationToken());
+			Promise<Uout> promise(dfd.promise());
+			settleWith([dfd = std::move(dfd), cbSuccess, cbFail](const T* v, const std::exception_ptr& e1)->void {
+				if (dfd.m_data->getState() != PromiseState::PENDING) {
+					return;
 				}
-			};
-
-			auto onFail = [dfd, cbFail](std::exception_ptr e1)->void {
-				try {
-					Promise<Uout> res = cbFail(e1);
-					auto onDone2 = [dfd](Uout v) { dfd.resolve(v); };
-					auto onFail2 = [dfd](std::exception_ptr e) { dfd.reject(e); };
-					res.done(onDone2, onFail2);
+				if (v) {
+					try {
+						detail::pipe_result(dfd, cbSuccess(*v));
+					}
+					catch (...) {
+						dfd.reject(std::current_exception());
+					}
+				} else {
+					try {
+						detail::pipe_result(dfd, cbFail(e1));
+					}
+					catch (...) {
+						dfd.reject(std::current_exception());
+					}
 				}
-				catch (std::exception e2) {
-					auto ep2 = std::current_exception();
-					dfd.reject(ep2);
-				}
-			};
-			done(onDone, onFail);
-			
-			return dfd.promise();
+			}, executor);
+
+			return promise;
 		}
         
         /// @brief registers a Callable handler to be called if/when the Promise resolves
         ///
         /// Optionally accepts a second parameter with a failure handler
         ///
-        /// @param cbSuccess  nullptr or any Callable target accepting one parameters of type T and returning void
+        /// @param cbSuccess  nullptr or any Callable target accepting one parameter of type const T& and returning void
         /// @param cbFail     nullptr or any Callable target accepting one parameter of type std::exception and returning void
-        const Promise<T> &done(typename Deferred<T>::Callback cbSuccess, typename Deferred<T>::ErrCallback cbFail = nullptr) const {
-            if (!m_data) {
+        /// @param executor   where to run the handlers; nullptr runs them on the thread which resolves this Promise
+        const Promise<T> &done(typename Deferred<T>::Callback cbSuccess, typename Deferred<T>::ErrCallback cbFail = nullptr, const ExecutorPtr& executor = nullptr) const {
+            if (!isValid()) {
                 throw std::runtime_error("Promise invalid");
             }
-            if (cbFail) {
-                fail(cbFail);
+            if (m_ready && !executor) {
+                if (cbSuccess) {
+                    cbSuccess(*m_ready);
+                }
+            } else if (cbSuccess || cbFail) {
+                sharedState()->addCallbacks(std::move(cbSuccess), std::move(cbFail), nullptr, executor);
             }
-            if (!cbSuccess) {
-                return *this;
+            return *this;
+        }
+        /// @brief registers a handler which takes the resolved value over instead of getting a const
+        /// reference to it; opt-in for the last listener of a Promise
+        ///
+        /// Use this for the final step of a chain which wants to keep a large value (e.g. a VariantList
+        /// or VariantMap) without copying it.  If cbSuccess is the last handler queued when the Promise
+        /// resolves, or the Promise has already resolved, the value is moved to it; if other handlers
+        /// are queued after it, or a handler has been sent to an executor (which may read the value at
+        /// any time), it gets a copy so they still see the value.  A Promise created with a value
+        /// (Promise(T)) always hands over a copy, since it keeps the value for get() and later
+        /// handlers.  Anything which reads a shared value after cbSuccess has run sees whatever it
+        /// left behind, so don't use consume on a Promise which other code may still listen to.
+        ///
+        /// @param cbSuccess  nullptr or any Callable target accepting one parameter of type T&& and returning void
+        /// @param cbFail     nullptr or any Callable target accepting one parameter of type std::exception and returning void
+        /// @param executor   where to run the handlers; nullptr runs them on the thread which resolves this Promise
+        const Promise<T> &consume(typename Deferred<T>::ConsumeCallback cbSuccess, typename Deferred<T>::ErrCallback cbFail = nullptr, const ExecutorPtr& executor = nullptr) const {
+            if (!isValid()) {
+                throw std::runtime_error("Promise invalid");
             }
-            if (m_data->state == PromiseState::PENDING) {
-                m_data->resolveList.emplace_back(cbSuccess);
-            } else if (m_data->state == PromiseState::RESOLVED) {
-                cbSuccess(m_data->value);
+            if (m_ready && !executor) {
+                if (cbSuccess) {
+                    T copy(*m_ready);
+                    cbSuccess(std::move(copy));
+                }
+            } else if (cbSuccess || cbFail) {
+                sharedState()->addCallbacks(nullptr, std::move(cbFail), std::move(cbSuccess), executor);
             }
             return *this;
         }
         /// @brief registers a Callable handler to be called if/when the Promise is rejected
         ///
         /// @param cbFail     nullptr or any Callable target accepting one parameter of type std::exception and returning void
-        const Promise<T> &fail(typename Deferred<T>::ErrCallback cbFail) const {
-            if (!m_data) {
+        /// @param executor   where to run the handler; nullptr runs it on the thread which rejects this Promise
+        const Promise<T> &fail(typename Deferred<T>::ErrCallback cbFail, const ExecutorPtr& executor = nullptr) const {
+            if (!isValid()) {
                 throw std::runtime_error("Promise invalid");
             }
-            if (!cbFail) {
-                return *this;
-            }
-            if (m_data->state == PromiseState::PENDING) {
-                m_data->rejectList.emplace_back(cbFail);
-            } else if (m_data->state == PromiseState::REJECTED) {
-                cbFail(m_data->err_ptr);
+            if (cbFail && !m_ready) {
+                m_data->addCallbacks(nullptr, std::move(cbFail), nullptr, executor);
             }
             return *this;
         }
         
     };
     
+    namespace detail {
+        // Lets code built on top of Promise (e.g. the combinators in PromiseCombinators.h) register
+        // one continuation for both outcomes, the way thenPipe does, rather than a done() handler
+        // and a fail() handler which each capture their own copy of its state
+        struct promise_access {
+            // Calls fn(&value, nullptr) or fn(nullptr, err) once promise is settled; an invalid
+            // promise counts as rejected
+            template <typename T, typename F>
+            static void settle(const Promise<T>& promise, F&& fn, const ExecutorPtr& executor = nullptr) {
+                if (!promise.isValid()) {
+                    fn(static_cast<const T*>(nullptr), std::make_exception_ptr(std::runtime_error("Promise invalid")));
+                    return;
+                }
+                promise.settleWith(std::forward<F>(fn), executor);
+            }
+            // False once dfd has settled, e.g. because it was cancelled
+            template <typename T>
+            static bool isPending(const Deferred<T>& dfd) {
+                return dfd.m_data->getState() == PromiseState::PENDING;
+            }
+        };
+    }
    
 }
 
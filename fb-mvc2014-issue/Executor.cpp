@@ -0,0 +1,72 @@
+/**********************************************************\
+Created:    Oct 15, 2026
+License:    Dual license model; choose one of two:
+            New BSD License
+            http://www.opensource.org/licenses/bsd-license.php
+            - or -
+            GNU Lesser General Public License, version 2.1
+            http://www.gnu.org/licenses/lgpl-2.1.html
+
+Copyright 2026 the FireBreath Dev Team
+\**********************************************************/
+
+#include "Executor.h"
+#include "precompiled_headers.h" // On windows, everything above this line in PCH
+
+using namespace FB;
+
+ExecutorPtr InlineExecutor::instance() {
+    static const ExecutorPtr executor(std::make_shared<InlineExecutor>());
+    return executor;
+}
+
+SerialExecutor::SerialExecutor(ExecutorPtr target)
+    : m_target(target ? std::move(target) : InlineExecutor::instance()), m_queue(std::make_shared<Queue>()) {
+}
+
+void SerialExecutor::execute(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(m_queue->mutex);
+        m_queue->tasks.emplace_back(std::move(task));
+        if (m_queue->running) {
+            // whoever is draining the queue will get to it
+            return;
+        }
+        m_queue->running = true;
+    }
+    schedule(m_target, m_queue);
+}
+
+void SerialExecutor::schedule(const ExecutorPtr& target, const std::shared_ptr<Queue>& queue) {
+    target->execute([target, queue]() { drain(target, queue); });
+}
+
+void SerialExecutor::drain(const ExecutorPtr& target, const std::shared_ptr<Queue>& queue) {
+    for (;;) {
+        Task task;
+        {
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            if (queue->tasks.empty()) {
+                queue->running = false;
+                return;
+            }
+            task = std::move(queue->tasks.front());
+            queue->tasks.pop_front();
+        }
+        try {
+            task();
+        } catch (...) {
+            // Leave the exception to the target, but don't strand the rest of the queue
+            bool more;
+            {
+                std::lock_guard<std::mutex> lock(queue->mutex);
+                more = !queue->tasks.empty();
+                queue->running = more;
+            }
+            if (more) {
+                schedule(target, queue);
+            }
+            throw;
+        }
+    }
+}
@@ -0,0 +1,98 @@
+/**********************************************************\
+Created:    Oct 15, 2026
+License:    Dual license model; choose one of two:
+            New BSD License
+            http://www.opensource.org/licenses/bsd-license.php
+            - or -
+            GNU Lesser General Public License, version 2.1
+            http://www.gnu.org/licenses/lgpl-2.1.html
+
+Copyright 2026 the FireBreath Dev Team
+\**********************************************************/
+
+#pragma once
+#ifndef H_FBEXECUTOR
+#define H_FBEXECUTOR
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include "Util/unique_function.h"
+
+namespace FB {
+
+    /// @brief A unit of work for an Executor; move-only, so tasks can own what they capture
+    using Task = unique_function<void()>;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @class  Executor
+    ///
+    /// @brief  Decides where (and when) a piece of work runs.
+    ///
+    /// FB::Promise::done, fail, then and thenPipe accept an optional FB::ExecutorPtr; when one is
+    /// given the handler is handed to the executor instead of being called on the thread which
+    /// resolves the promise, deep inside FB::Deferred::resolve.
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    class Executor
+    {
+    public:
+        virtual ~Executor() {}
+
+        /// @brief Runs task, either right away or at some later point on some thread
+        virtual void execute(Task task) = 0;
+    };
+    using ExecutorPtr = std::shared_ptr<Executor>;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @class  InlineExecutor
+    ///
+    /// @brief  Runs work immediately on the calling thread; the same as passing no executor at all
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    class InlineExecutor final : public Executor
+    {
+    public:
+        void execute(Task task) override {
+            task();
+        }
+
+        /// @brief Returns the shared InlineExecutor instance
+        static ExecutorPtr instance();
+    };
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @class  SerialExecutor
+    ///
+    /// @brief  A strand: runs work one item at a time, in the order it was submitted, on top of
+    ///         another executor.
+    ///
+    /// Work submitted to a SerialExecutor never runs concurrently with other work submitted to the
+    /// same SerialExecutor, so handlers which touch the same data don't need a lock even when the
+    /// underlying executor is a thread pool.  Only one item is handed to the underlying executor at
+    /// a time; it drains the queue before returning.
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    class SerialExecutor final : public Executor
+    {
+    public:
+        /// @brief Creates a strand which runs its work on target (inline if target is empty)
+        explicit SerialExecutor(ExecutorPtr target = ExecutorPtr());
+
+        void execute(Task task) override;
+
+    private:
+        // Kept separately so that work already handed to the target keeps the queue alive even
+        // after the SerialExecutor itself is gone
+        struct Queue {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+            bool running = false;
+        };
+        static void schedule(const ExecutorPtr& target, const std::shared_ptr<Queue>& queue);
+        static void drain(const ExecutorPtr& target, const std::shared_ptr<Queue>& queue);
+
+        ExecutorPtr m_target;
+        std::shared_ptr<Queue> m_queue;
+    };
+
+}
+
+#endif // H_FBEXECUTOR
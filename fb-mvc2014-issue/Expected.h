@@ -0,0 +1,97 @@
+/**********************************************************\
+Created:    Oct 15, 2026
+License:    Dual license model; choose one of two:
+            New BSD License
+            http://www.opensource.org/licenses/bsd-license.php
+            - or -
+            GNU Lesser General Public License, version 2.1
+            http://www.gnu.org/licenses/lgpl-2.1.html
+
+Copyright 2026 the FireBreath Dev Team
+\**********************************************************/
+
+#pragma once
+#ifndef H_FBEXPECTED
+#define H_FBEXPECTED
+
+#include <exception>
+#include <utility>
+
+namespace FB {
+
+    /// @brief The error half of an FB::Expected; see FB::make_unexpected
+    struct Unexpected {
+        std::exception_ptr error;
+    };
+
+    /// @brief Wraps ep so that it can be returned as any FB::Expected<T>
+    inline Unexpected make_unexpected(std::exception_ptr ep) {
+        return Unexpected{ std::move(ep) };
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @class  Expected
+    ///
+    /// @brief  Either a value of type T or the exception which kept it from being produced, without
+    ///         anything being thrown.
+    ///
+    /// This is the non-throwing way to fail in a Promise chain: a FB::Promise::thenPipe handler may
+    /// return an Expected<Uout> instead of a Promise<Uout>, and FB::Deferred::settle takes one, so a
+    /// hot path can reject without unwinding the stack.  Building the exception_ptr itself may still
+    /// throw internally with some compilers (make_exception_ptr does on VS2015), so code which fails
+    /// often should create it once and reuse it.
+    ///
+    /// @code
+    ///      static const std::exception_ptr notFound(std::make_exception_ptr(std::runtime_error("not found")));
+    ///      promise.thenPipe<FB::variant>([](const FB::variant& key) -> FB::Expected<FB::variant> {
+    ///          auto it = cache.find(key);
+    ///          if (it == cache.end()) {
+    ///              return FB::make_unexpected(notFound);
+    ///          }
+    ///          return it->second;
+    ///      });
+    /// @endcode
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    template <typename T>
+    class Expected
+    {
+    public:
+        Expected(T value) : m_value(std::move(value)), m_hasValue(true) {}
+        Expected(Unexpected unexpected) : m_value(), m_error(std::move(unexpected.error)), m_hasValue(false) {}
+
+        /// @brief Returns true if this holds a value rather than an error
+        bool hasValue() const { return m_hasValue; }
+        explicit operator bool() const { return m_hasValue; }
+
+        /// @brief Returns the value; rethrows the error if there is none
+        const T& value() const & {
+            if (!m_hasValue) {
+                std::rethrow_exception(m_error);
+            }
+            return m_value;
+        }
+        T& value() & {
+            if (!m_hasValue) {
+                std::rethrow_exception(m_error);
+            }
+            return m_value;
+        }
+        T&& value() && {
+            if (!m_hasValue) {
+                std::rethrow_exception(m_error);
+            }
+            return std::move(m_value);
+        }
+
+        /// @brief Returns the error; empty if this holds a value
+        const std::exception_ptr& error() const { return m_error; }
+
+    private:
+        T m_value;
+        std::exception_ptr m_error;
+        bool m_hasValue;
+    };
+
+}
+
+#endif // H_FBEXPECTED
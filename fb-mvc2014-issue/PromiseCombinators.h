@@ -0,0 +1,344 @@
+/**********************************************************\
+Created:    Oct 15, 2026
+License:    Dual license model; choose one of two:
+            New BSD License
+            http://www.opensource.org/licenses/bsd-license.php
+            - or -
+            GNU Lesser General Public License, version 2.1
+            http://www.gnu.org/licenses/lgpl-2.1.html
+
+Copyright 2026 the FireBreath Dev Team
+\**********************************************************/
+
+#pragma once
+#ifndef H_FBPROMISECOMBINATORS
+#define H_FBPROMISECOMBINATORS
+
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <boost/optional.hpp>
+#include "Deferred.h"
+
+// Functions which wait on many FB::Promise objects at once.
+//
+// Each of them allocates one shared state holding the results, a countdown and the Deferred for
+// the returned Promise, and registers a single continuation on each input which writes its slot
+// and counts down; nothing is chained per element.  The ranges may hold any iterable container
+// of FB::Promise<T> (or a forward iterator pair), e.g. a FB::VariantPromiseList.  An invalid
+// Promise in the input counts as rejected.
+//
+// The returned Promise carries the CancellationToken of the first input which has one; once it is
+// cancelled the result rejects with FB::PromiseCancelled and the inputs which settle after that
+// are ignored.
+
+namespace FB {
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @struct SettledResult
+    ///
+    /// @brief  Outcome of one Promise, as reported by FB::all_settled
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    template <typename T>
+    struct SettledResult {
+        PromiseState state;         // RESOLVED or REJECTED
+        boost::optional<T> value;   // the value if RESOLVED
+        std::exception_ptr error;   // the exception if REJECTED
+    };
+
+    namespace detail {
+        template <typename T>
+        struct is_promise : std::false_type {};
+        template <typename T>
+        struct is_promise<Promise<T>> : std::true_type {};
+
+        // Enables the iterator pair overloads only for iterators over Promise objects, so that
+        // when_all(p1, p2) picks the variadic overload
+        template <typename It>
+        using promise_iterator_value = typename std::enable_if<
+            is_promise<typename std::decay<decltype(*std::declval<It&>())>::type>::value,
+            typename std::decay<decltype(*std::declval<It&>())>::type>::type;
+
+        template <typename Range>
+        using promise_range_iterator = decltype(std::begin(std::declval<const Range&>()));
+
+        // The token the result of a combinator carries
+        template <typename It>
+        CancellationToken first_token(It first, It last) {
+            for (; first != last; ++first) {
+                CancellationToken token(first->cancellationToken());
+                if (token) {
+                    return token;
+                }
+            }
+            return CancellationToken();
+        }
+        inline CancellationToken first_token() {
+            return CancellationToken();
+        }
+        template <typename U, typename... Us>
+        CancellationToken first_token(const Promise<U>& promise, const Promise<Us>&... promises) {
+            CancellationToken token(promise.cancellationToken());
+            return token ? token : first_token(promises...);
+        }
+
+        template <typename T>
+        struct when_all_state {
+            when_all_state(std::size_t count, const CancellationToken& token) : results(count), remaining(count), dfd(token) {}
+
+            // Called by whoever fills the last slot
+            std::vector<T> take() {
+                std::vector<T> values;
+                values.reserve(results.size());
+                for (boost::optional<T>& slot : results) {
+                    values.emplace_back(std::move(*slot));
+                }
+                return values;
+            }
+
+            // Slots are filled concurrently from whichever threads settle the inputs, so they must be
+            // separate objects: std::vector<bool> would pack them into shared words
+            std::vector<boost::optional<T>> results;
+            std::atomic<std::size_t> remaining;
+            Deferred<std::vector<T>> dfd;
+        };
+
+        template <typename T>
+        struct when_any_state {
+            when_any_state(std::size_t count, const CancellationToken& token) : remaining(count), dfd(token) {}
+            std::atomic<std::size_t> remaining;     // inputs which have not been rejected yet
+            Deferred<std::pair<std::size_t, T>> dfd;
+        };
+
+        template <typename T>
+        struct all_settled_state {
+            all_settled_state(std::size_t count, const CancellationToken& token) : results(count), remaining(count), dfd(token) {}
+            // Each value is an optional slot, as in when_all_state, so no T is made only to be
+            // overwritten
+            std::vector<SettledResult<T>> results;
+            std::atomic<std::size_t> remaining;
+            Deferred<std::vector<SettledResult<T>>> dfd;
+        };
+
+        template <typename... Ts>
+        struct when_all_tuple_state {
+            explicit when_all_tuple_state(const CancellationToken& token) : remaining(sizeof...(Ts)), dfd(token) {}
+
+            // Called by whoever fills the last slot
+            std::tuple<Ts...> take() {
+                return take(std::index_sequence_for<Ts...>());
+            }
+            template <std::size_t... I>
+            std::tuple<Ts...> take(std::index_sequence<I...>) {
+                return std::tuple<Ts...>(std::move(*std::get<I>(results))...);
+            }
+
+            std::tuple<boost::optional<Ts>...> results;
+            std::atomic<std::size_t> remaining;
+            Deferred<std::tuple<Ts...>> dfd;
+        };
+
+        template <std::size_t I, typename State, typename U>
+        void when_all_tuple_add(const std::shared_ptr<State>& state, const Promise<U>& promise) {
+            promise_access::settle(promise, [state](const U* v, const std::exception_ptr& e) {
+                if (!promise_access::isPending(state->dfd)) {
+                    return;
+                }
+                if (!v) {
+                    state->dfd.reject(e);
+                } else {
+                    std::get<I>(state->results) = *v;
+                    if (state->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                        state->dfd.resolve(state->take());
+                    }
+                }
+            });
+        }
+
+        template <typename... Ts, std::size_t... I>
+        Promise<std::tuple<Ts...>> when_all_tuple(std::index_sequence<I...>, const Promise<Ts>&... promises) {
+            auto state = std::make_shared<when_all_tuple_state<Ts...>>(first_token(promises...));
+            Promise<std::tuple<Ts...>> result(state->dfd.promise());
+            int expand[] = { 0, (when_all_tuple_add<I>(state, promises), 0)... };
+            (void)expand;
+            return result;
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @fn template <typename It> Promise<std::vector<T>> when_all(It first, It last)
+    ///
+    /// @brief  Returns a Promise which resolves to the values of all of [first, last), in order, once
+    ///         they have all resolved; it rejects as soon as any of them rejects, with that exception.
+    ///
+    /// An empty range resolves right away to an empty vector.
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    template <typename It, typename P = detail::promise_iterator_value<It>>
+    Promise<std::vector<typename P::type>> when_all(It first, It last) {
+        using T = typename P::type;
+        const std::size_t count = static_cast<std::size_t>(std::distance(first, last));
+        if (!count) {
+            return Promise<std::vector<T>>(std::vector<T>());
+        }
+        auto state = std::make_shared<detail::when_all_state<T>>(count, detail::first_token(first, last));
+        Promise<std::vector<T>> result(state->dfd.promise());
+        for (std::size_t i = 0; first != last; ++first, ++i) {
+            detail::promise_access::settle(*first, [state, i](const T* v, const std::exception_ptr& e) {
+                if (!detail::promise_access::isPending(state->dfd)) {
+                    return;
+                }
+                if (!v) {
+                    state->dfd.reject(e);
+                } else {
+                    state->results[i] = *v;
+                    if (state->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                        state->dfd.resolve(state->take());
+                    }
+                }
+            });
+        }
+        return result;
+    }
+    template <typename Range, typename It = detail::promise_range_iterator<Range>, typename P = detail::promise_iterator_value<It>>
+    Promise<std::vector<typename P::type>> when_all(const Range& promises) {
+        return when_all(std::begin(promises), std::end(promises));
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @fn template <typename... Ts> Promise<std::tuple<Ts...>> when_all(const Promise<Ts>&... promises)
+    ///
+    /// @brief  Heterogeneous when_all: resolves to a tuple of the values of all the arguments once
+    ///         they have all resolved; rejects as soon as any of them rejects.
+    ///
+    /// @code
+    ///      FB::when_all(getName(), getAge()).done([](const std::tuple<std::string, int>& res) { ... });
+    /// @endcode
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    template <typename T, typename... Ts>
+    Promise<std::tuple<T, Ts...>> when_all(const Promise<T>& promise, const Promise<Ts>&... promises) {
+        return detail::when_all_tuple(std::index_sequence_for<T, Ts...>(), promise, promises...);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @fn template <typename It> Promise<std::pair<std::size_t, T>> when_any(It first, It last)
+    ///
+    /// @brief  Returns a Promise which resolves to the index and value of the first of [first, last)
+    ///         to resolve.  Rejections are ignored unless all of them reject, in which case it rejects
+    ///         with the exception of the last one to do so.
+    ///
+    /// An empty range rejects right away.
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    template <typename It, typename P = detail::promise_iterator_value<It>>
+    Promise<std::pair<std::size_t, typename P::type>> when_any(It first, It last) {
+        using T = typename P::type;
+        const std::size_t count = static_cast<std::size_t>(std::distance(first, last));
+        if (!count) {
+            return Promise<std::pair<std::size_t, T>>::rejected(std::make_exception_ptr(std::runtime_error("when_any: no Promises")));
+        }
+        auto state = std::make_shared<detail::when_any_state<T>>(count, detail::first_token(first, last));
+        Promise<std::pair<std::size_t, T>> result(state->dfd.promise());
+        for (std::size_t i = 0; first != last; ++first, ++i) {
+            detail::promise_access::settle(*first, [state, i](const T* v, const std::exception_ptr& e) {
+                if (!detail::promise_access::isPending(state->dfd)) {
+                    return;
+                }
+                if (v) {
+                    state->dfd.resolve(std::make_pair(i, *v));
+                } else if (state->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    state->dfd.reject(e);
+                }
+            });
+        }
+        return result;
+    }
+    template <typename Range, typename It = detail::promise_range_iterator<Range>, typename P = detail::promise_iterator_value<It>>
+    Promise<std::pair<std::size_t, typename P::type>> when_any(const Range& promises) {
+        return when_any(std::begin(promises), std::end(promises));
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @fn template <typename It> Promise<T> race(It first, It last)
+    ///
+    /// @brief  Returns a Promise which resolves or rejects like the first of [first, last) to settle.
+    ///
+    /// An empty range rejects right away.
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    template <typename It, typename P = detail::promise_iterator_value<It>>
+    P race(It first, It last) {
+        using T = typename P::type;
+        if (first == last) {
+            return P::rejected(std::make_exception_ptr(std::runtime_error("race: no Promises")));
+        }
+        // nothing to count, so the Deferred is the whole shared state
+        Deferred<T> dfd(detail::first_token(first, last));
+        P result(dfd.promise());
+        for (; first != last; ++first) {
+            detail::promise_access::settle(*first, [dfd](const T* v, const std::exception_ptr& e) {
+                if (!detail::promise_access::isPending(dfd)) {
+                    return;
+                }
+                if (v) {
+                    dfd.resolve(*v);
+                } else {
+                    dfd.reject(e);
+                }
+            });
+        }
+        return result;
+    }
+    template <typename Range, typename It = detail::promise_range_iterator<Range>, typename P = detail::promise_iterator_value<It>>
+    P race(const Range& promises) {
+        return race(std::begin(promises), std::end(promises));
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @fn template <typename It> Promise<std::vector<SettledResult<T>>> all_settled(It first, It last)
+    ///
+    /// @brief  Returns a Promise which resolves once every one of [first, last) has resolved or
+    ///         rejected, to the outcome of each of them in order.  It never rejects.
+    ///
+    /// An empty range resolves right away to an empty vector.
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    template <typename It, typename P = detail::promise_iterator_value<It>>
+    Promise<std::vector<SettledResult<typename P::type>>> all_settled(It first, It last) {
+        using T = typename P::type;
+        const std::size_t count = static_cast<std::size_t>(std::distance(first, last));
+        if (!count) {
+            return Promise<std::vector<SettledResult<T>>>(std::vector<SettledResult<T>>());
+        }
+        auto state = std::make_shared<detail::all_settled_state<T>>(count, detail::first_token(first, last));
+        Promise<std::vector<SettledResult<T>>> result(state->dfd.promise());
+        for (std::size_t i = 0; first != last; ++first, ++i) {
+            detail::promise_access::settle(*first, [state, i](const T* v, const std::exception_ptr& e) {
+                if (!detail::promise_access::isPending(state->dfd)) {
+                    return;
+                }
+                SettledResult<T>& slot = state->results[i];
+                if (v) {
+                    slot.state = PromiseState::RESOLVED;
+                    slot.value = *v;
+                } else {
+                    slot.state = PromiseState::REJECTED;
+                    slot.error = e;
+                }
+                if (state->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    state->dfd.resolve(std::move(state->results));
+                }
+            });
+        }
+        return result;
+    }
+    template <typename Range, typename It = detail::promise_range_iterator<Range>, typename P = detail::promise_iterator_value<It>>
+    Promise<std::vector<SettledResult<typename P::type>>> all_settled(const Range& promises) {
+        return all_settled(std::begin(promises), std::end(promises));
+    }
+
+}
+
+#endif // H_FBPROMISECOMBINATORS
@@ -0,0 +1,126 @@
+/**********************************************************\
+Created:    Oct 15, 2026
+License:    Dual license model; choose one of two:
+            New BSD License
+            http://www.opensource.org/licenses/bsd-license.php
+            - or -
+            GNU Lesser General Public License, version 2.1
+            http://www.gnu.org/licenses/lgpl-2.1.html
+
+Copyright 2026 the FireBreath Dev Team
+\**********************************************************/
+
+#pragma once
+#ifndef H_FBPROMISECOROUTINE
+#define H_FBPROMISECOROUTINE
+
+#include "Deferred.h"
+
+// C++20 coroutine support for FB::Promise; empty unless the compiler implements coroutines.
+//
+// With this header included a FB::Promise<T> can be awaited, and a function returning
+// FB::Promise<T> can be a coroutine:
+//
+//      FB::Promise<int> getLength(FB::Promise<std::string> name) {
+//          std::string n = co_await name;  // rethrows if name is rejected
+//          co_return static_cast<int>(n.size());
+//      }
+//
+// A sequence of steps written this way lives in one coroutine frame instead of allocating a
+// Deferred and a continuation per thenPipe.  The thread which resolves an awaited Promise resumes
+// the coroutine directly; if it is already settled the coroutine doesn't suspend at all.  The
+// coroutine starts running as soon as it is called, and the Promise it returns resolves with the
+// value of co_return, or rejects with whatever exception escapes the body.
+
+#if defined(__cpp_impl_coroutine)
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+namespace FB {
+
+    namespace detail {
+        template <typename T>
+        class promise_awaiter
+        {
+        public:
+            explicit promise_awaiter(Promise<T> promise) : m_promise(std::move(promise)), m_value(nullptr), m_armed(false) {}
+
+            bool await_ready() const noexcept {
+                return false;
+            }
+
+            // Whichever of this and the continuation gets to m_armed second carries on: the
+            // continuation resumes the coroutine, or this returns false so it never suspends
+            bool await_suspend(std::coroutine_handle<> handle) {
+                m_handle = handle;
+                promise_access::settle(m_promise, [this](const T* v, const std::exception_ptr& e) {
+                    m_value = v;
+                    m_error = e;
+                    if (m_armed.exchange(true, std::memory_order_acq_rel)) {
+                        m_handle.resume();
+                    }
+                });
+                return !m_armed.exchange(true, std::memory_order_acq_rel);
+            }
+
+            // m_value points into the shared state, which m_promise keeps alive
+            T await_resume() {
+                if (!m_value) {
+                    std::rethrow_exception(m_error);
+                }
+                return *m_value;
+            }
+
+        private:
+            Promise<T> m_promise;
+            std::coroutine_handle<> m_handle;
+            const T* m_value;
+            std::exception_ptr m_error;
+            std::atomic<bool> m_armed;
+        };
+
+        template <typename T>
+        class promise_coroutine
+        {
+        public:
+            Promise<T> get_return_object() {
+                return m_dfd.promise();
+            }
+            std::suspend_never initial_suspend() noexcept {
+                return {};
+            }
+            std::suspend_never final_suspend() noexcept {
+                return {};
+            }
+            void return_value(T v) {
+                m_dfd.resolve(std::move(v));
+            }
+            void unhandled_exception() {
+                m_dfd.reject(std::current_exception());
+            }
+
+        private:
+            Deferred<T> m_dfd;
+        };
+    }
+
+    template <typename T>
+    detail::promise_awaiter<T> operator co_await(Promise<T> promise) {
+        return detail::promise_awaiter<T>(std::move(promise));
+    }
+
+}
+
+namespace std {
+    template <typename T, typename... Args>
+    struct coroutine_traits<FB::Promise<T>, Args...> {
+        using promise_type = FB::detail::promise_coroutine<T>;
+    };
+}
+
+#endif // __cpp_impl_coroutine
+
+#endif // H_FBPROMISECOROUTINE
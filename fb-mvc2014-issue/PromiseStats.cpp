@@ -0,0 +1,238 @@
+/**********************************************************\
+Created:    Oct 16, 2026
+License:    Dual license model; choose one of two:
+            New BSD License
+            http://www.opensource.org/licenses/bsd-license.php
+            - or -
+            GNU Lesser General Public License, version 2.1
+            http://www.gnu.org/licenses/lgpl-2.1.html
+
+Copyright 2026 the FireBreath Dev Team
+\**********************************************************/
+
+#include "PromiseStats.h"
+#include "precompiled_headers.h" // On windows, everything above this line in PCH
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+using namespace FB;
+using namespace FB::detail;
+
+void PromiseHistogram::add(std::chrono::steady_clock::duration d) {
+    const std::int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+    std::size_t i = 0;
+    while (i < BucketCount - 1 && us >= upperBound(i).count()) {
+        ++i;
+    }
+    ++buckets[i];
+}
+
+std::uint64_t PromiseHistogram::total() const {
+    std::uint64_t sum = 0;
+    for (std::uint64_t count : buckets) {
+        sum += count;
+    }
+    return sum;
+}
+
+#ifdef FB_DEFERRED_INSTRUMENTATION
+
+namespace FB { namespace detail {
+    struct callsite_stats {
+        explicit callsite_stats(const char* name) : name(name), created(0), live(0), pending(0), destroyedPending(0) {}
+
+        const char* name;
+        std::atomic<std::uint64_t> created;
+        std::atomic<std::uint64_t> live;
+        std::atomic<std::uint64_t> pending;
+        std::atomic<std::uint64_t> destroyedPending;
+    };
+
+    struct promise_registry {
+        promise_registry() : unknown("(none)"), created(0), live(0), resolved(0), rejected(0),
+            destroyedPending(0), invalidatedPending(0), head(nullptr), tail(nullptr), pending(0) {}
+
+        // Never destroyed: shared states may well outlive static destruction
+        static promise_registry& instance() {
+            static promise_registry* registry = new promise_registry();
+            return *registry;
+        }
+
+        callsite_stats* callsite(const char* name) {
+            std::lock_guard<std::mutex> lock(mutex);
+            // keyed by address; the same name from different literals is merged by snapshot()
+            std::unique_ptr<callsite_stats>& entry(callsites[name]);
+            if (!entry) {
+                entry.reset(new callsite_stats(name));
+            }
+            return entry.get();
+        }
+
+        // Called with mutex held
+        void link(promise_record* record) {
+            record->m_prev = tail;
+            record->m_next = nullptr;
+            if (tail) {
+                tail->m_next = record;
+            } else {
+                head = record;
+            }
+            tail = record;
+            record->m_linked = true;
+            ++pending;
+        }
+        void unlink(promise_record* record) {
+            if (record->m_prev) {
+                record->m_prev->m_next = record->m_next;
+            } else {
+                head = record->m_next;
+            }
+            if (record->m_next) {
+                record->m_next->m_prev = record->m_prev;
+            } else {
+                tail = record->m_prev;
+            }
+            record->m_prev = record->m_next = nullptr;
+            record->m_linked = false;
+            --pending;
+        }
+
+        callsite_stats unknown;
+        std::atomic<std::uint64_t> created;
+        std::atomic<std::uint64_t> live;
+        std::atomic<std::uint64_t> resolved;
+        std::atomic<std::uint64_t> rejected;
+        std::atomic<std::uint64_t> destroyedPending;
+        std::atomic<std::uint64_t> invalidatedPending;
+
+        std::mutex mutex;               // guards everything below
+        std::unordered_map<const char*, std::unique_ptr<callsite_stats>> callsites;
+        promise_record* head;           // pending states, oldest first
+        promise_record* tail;
+        std::uint64_t pending;
+        PromiseHistogram resolveLatency;
+        PromiseHistogram rejectLatency;
+    };
+} }
+
+namespace {
+    thread_local callsite_stats* t_callsite = nullptr;
+}
+
+promise_record::promise_record(bool pending)
+    : m_created(std::chrono::steady_clock::now()), m_prev(nullptr), m_next(nullptr), m_linked(false) {
+    promise_registry& registry(promise_registry::instance());
+    m_callsite = t_callsite ? t_callsite : &registry.unknown;
+    registry.created.fetch_add(1, std::memory_order_relaxed);
+    registry.live.fetch_add(1, std::memory_order_relaxed);
+    m_callsite->created.fetch_add(1, std::memory_order_relaxed);
+    m_callsite->live.fetch_add(1, std::memory_order_relaxed);
+    if (pending) {
+        m_callsite->pending.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.link(this);
+    }
+}
+
+promise_record::~promise_record() {
+    promise_registry& registry(promise_registry::instance());
+    registry.live.fetch_sub(1, std::memory_order_relaxed);
+    m_callsite->live.fetch_sub(1, std::memory_order_relaxed);
+    if (m_linked) {
+        // destroyed pending without anything to reject; onAbandoned has counted it
+        m_callsite->pending.fetch_sub(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.unlink(this);
+    }
+}
+
+void promise_record::onSettled(bool resolved) {
+    promise_registry& registry(promise_registry::instance());
+    const std::chrono::steady_clock::duration latency(std::chrono::steady_clock::now() - m_created);
+    (resolved ? registry.resolved : registry.rejected).fetch_add(1, std::memory_order_relaxed);
+    m_callsite->pending.fetch_sub(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.unlink(this);
+    (resolved ? registry.resolveLatency : registry.rejectLatency).add(latency);
+}
+
+void promise_record::onAbandoned() {
+    promise_registry::instance().destroyedPending.fetch_add(1, std::memory_order_relaxed);
+    m_callsite->destroyedPending.fetch_add(1, std::memory_order_relaxed);
+}
+
+void promise_record::onInvalidated() {
+    promise_registry::instance().invalidatedPending.fetch_add(1, std::memory_order_relaxed);
+}
+
+PromiseCallsite::PromiseCallsite(const char* name) : m_previous(t_callsite) {
+    t_callsite = promise_registry::instance().callsite(name);
+}
+
+PromiseCallsite::~PromiseCallsite() {
+    t_callsite = m_previous;
+}
+
+PromiseStatsSnapshot PromiseStats::snapshot(std::size_t maxPending) {
+    promise_registry& registry(promise_registry::instance());
+    PromiseStatsSnapshot stats;
+    stats.enabled = true;
+    stats.taken = std::chrono::steady_clock::now();
+
+    std::map<std::string, PromiseStatsSnapshot::Callsite> callsites;
+    auto addCallsite = [&callsites](const callsite_stats& site) {
+        PromiseStatsSnapshot::Callsite& entry(callsites[site.name]);
+        entry.name = site.name;
+        entry.created += site.created.load(std::memory_order_relaxed);
+        entry.live += site.live.load(std::memory_order_relaxed);
+        entry.pending += site.pending.load(std::memory_order_relaxed);
+        entry.destroyedPending += site.destroyedPending.load(std::memory_order_relaxed);
+    };
+    {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        stats.pending = registry.pending;
+        stats.resolveLatency = registry.resolveLatency;
+        stats.rejectLatency = registry.rejectLatency;
+        for (promise_record* record = registry.head; record; record = record->m_next) {
+            stats.pendingAge.add(stats.taken - record->m_created);
+            if (stats.oldestPending.size() < maxPending) {
+                PromiseStatsSnapshot::PendingPromise entry;
+                entry.callsite = record->m_callsite->name;
+                entry.created = record->m_created;
+                entry.age = stats.taken - record->m_created;
+                stats.oldestPending.push_back(entry);
+            }
+        }
+        for (const auto& site : registry.callsites) {
+            addCallsite(*site.second);
+        }
+    }
+    addCallsite(registry.unknown);
+
+    stats.created = registry.created.load(std::memory_order_relaxed);
+    stats.live = registry.live.load(std::memory_order_relaxed);
+    stats.resolved = registry.resolved.load(std::memory_order_relaxed);
+    stats.rejected = registry.rejected.load(std::memory_order_relaxed);
+    stats.destroyedPending = registry.destroyedPending.load(std::memory_order_relaxed);
+    stats.invalidatedPending = registry.invalidatedPending.load(std::memory_order_relaxed);
+    for (auto& site : callsites) {
+        if (site.second.created) {
+            stats.callsites.push_back(site.second);
+        }
+    }
+    return stats;
+}
+
+#else
+
+PromiseStatsSnapshot PromiseStats::snapshot(std::size_t) {
+    PromiseStatsSnapshot stats;
+    stats.taken = std::chrono::steady_clock::now();
+    return stats;
+}
+
+#endif // FB_DEFERRED_INSTRUMENTATION
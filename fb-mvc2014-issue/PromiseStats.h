@@ -0,0 +1,219 @@
+/**********************************************************\
+Created:    Oct 16, 2026
+License:    Dual license model; choose one of two:
+            New BSD License
+            http://www.opensource.org/licenses/bsd-license.php
+            - or -
+            GNU Lesser General Public License, version 2.1
+            http://www.gnu.org/licenses/lgpl-2.1.html
+
+Copyright 2026 the FireBreath Dev Team
+\**********************************************************/
+
+#pragma once
+#ifndef H_FBPROMISESTATS
+#define H_FBPROMISESTATS
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Instrumentation of the state shared by FB::Deferred and FB::Promise: how many states are alive,
+// how long they stay pending, which ones are dropped while still pending, and where they were made.
+//
+// It is only compiled in when FB_DEFERRED_INSTRUMENTATION is defined.  The macro changes the layout
+// of the shared state, so it has to be set the same way for every translation unit (i.e. in the
+// project's preprocessor definitions, not in a source file).  Without it the hooks are empty inline
+// functions of an empty base class and cost nothing; PromiseStats::snapshot() still exists and
+// returns an empty snapshot, so code which reports the numbers doesn't need an #ifdef of its own.
+//
+// With it, creating, settling and destroying a pending state each take a global lock briefly.
+
+namespace FB {
+
+    class PromiseStats;
+    class PromiseCallsite;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @struct PromiseHistogram
+    ///
+    /// @brief  Durations counted in power of two buckets of microseconds.
+    ///
+    /// Bucket 0 counts durations under 1us, bucket i those from 2^(i-1) up to 2^i us, and the last
+    /// bucket everything longer than that.
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    struct PromiseHistogram
+    {
+        static const std::size_t BucketCount = 32;
+
+        PromiseHistogram() : buckets() {}
+
+        /// @brief Returns the (exclusive) upper bound of bucket i; the last bucket has none
+        static std::chrono::microseconds upperBound(std::size_t i) {
+            return std::chrono::microseconds(static_cast<std::int64_t>(1) << i);
+        }
+        void add(std::chrono::steady_clock::duration d);
+        std::uint64_t total() const;
+
+        std::uint64_t buckets[BucketCount];
+    };
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @struct PromiseStatsSnapshot
+    ///
+    /// @brief  The counters of PromiseStats at one point in time; see PromiseStats::snapshot().
+    ///
+    /// Only shared states are counted: a Promise created already resolved (Promise(T)) has none.
+    /// States created already settled (Deferred(T), Deferred(exception_ptr)) count as created and
+    /// live, but not as resolved or rejected.
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    struct PromiseStatsSnapshot
+    {
+        struct Callsite {
+            std::string name;                   // as given to PromiseCallsite; "(none)" outside of one
+            std::uint64_t created;
+            std::uint64_t live;
+            std::uint64_t pending;
+            std::uint64_t destroyedPending;
+        };
+        struct PendingPromise {
+            std::string callsite;
+            std::chrono::steady_clock::time_point created;
+            std::chrono::steady_clock::duration age;
+        };
+
+        PromiseStatsSnapshot() : enabled(false), created(0), live(0), pending(0), resolved(0), rejected(0),
+            destroyedPending(0), invalidatedPending(0) {}
+
+        bool enabled;                           // false unless built with FB_DEFERRED_INSTRUMENTATION
+        std::chrono::steady_clock::time_point taken;
+
+        std::uint64_t created;                  // shared states created so far
+        std::uint64_t live;                     // shared states not destroyed yet
+        std::uint64_t pending;                  // of those, the ones which haven't settled
+        std::uint64_t resolved;                 // states which were resolved after being created pending
+        std::uint64_t rejected;                 // likewise rejected, including those counted below
+        std::uint64_t destroyedPending;         // destroyed while pending ("Deferred object destroyed: 1")
+        std::uint64_t invalidatedPending;       // Deferred::invalidate() while pending ("... destroyed: 2")
+
+        PromiseHistogram resolveLatency;        // time from creation to resolution
+        PromiseHistogram rejectLatency;         // time from creation to rejection
+        PromiseHistogram pendingAge;            // age of every state which is pending right now
+
+        std::vector<Callsite> callsites;        // sorted by name
+        std::vector<PendingPromise> oldestPending;  // oldest first
+    };
+
+    namespace detail {
+        struct callsite_stats;
+
+#ifdef FB_DEFERRED_INSTRUMENTATION
+        // Base class of the shared state of a Deferred; registers it with PromiseStats
+        class promise_record
+        {
+        public:
+            explicit promise_record(bool pending);
+            ~promise_record();
+
+            // Called once by the thread which settles a state created pending
+            void onSettled(bool resolved);
+            // Called when a state is destroyed, or its Deferred invalidated, while still pending
+            void onAbandoned();
+            void onInvalidated();
+
+        private:
+            friend class FB::PromiseStats;
+            friend struct promise_registry;
+            promise_record(const promise_record&) = delete;
+            promise_record& operator=(const promise_record&) = delete;
+
+            std::chrono::steady_clock::time_point m_created;
+            callsite_stats* m_callsite;
+            promise_record* m_prev;             // in the list of pending states, oldest first
+            promise_record* m_next;
+            bool m_linked;
+        };
+#else
+        class promise_record
+        {
+        public:
+            explicit promise_record(bool) {}
+
+            void onSettled(bool) {}
+            void onAbandoned() {}
+            void onInvalidated() {}
+        };
+#endif
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @class  PromiseStats
+    ///
+    /// @brief  Reads the counters kept when built with FB_DEFERRED_INSTRUMENTATION.
+    ///
+    /// @code
+    ///      FB::PromiseStatsSnapshot stats(FB::PromiseStats::snapshot());
+    ///      for (const auto& p : stats.oldestPending) {
+    ///          if (p.age > std::chrono::minutes(1)) {
+    ///              log("promise from " + p.callsite + " has been pending for over a minute");
+    ///          }
+    ///      }
+    /// @endcode
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    class PromiseStats final
+    {
+    public:
+        /// @brief Returns true if instrumentation is compiled in
+        static bool enabled() {
+#ifdef FB_DEFERRED_INSTRUMENTATION
+            return true;
+#else
+            return false;
+#endif
+        }
+        /// @brief Returns the current counters, with at most maxPending entries in oldestPending
+        static PromiseStatsSnapshot snapshot(std::size_t maxPending = 16);
+    };
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @class  PromiseCallsite
+    ///
+    /// @brief  Names the code creating Deferreds on the current thread, for the per-callsite counts
+    ///         of PromiseStats.
+    ///
+    /// Every shared state created on this thread while the PromiseCallsite exists (including those
+    /// of the continuations made by then and thenPipe) is counted under name.  name must be a
+    /// string literal or otherwise outlive the program.  They may be nested; the innermost wins.
+    /// Without FB_DEFERRED_INSTRUMENTATION this does nothing.
+    ///
+    /// @code
+    ///      FB::Promise<FB::variant> MyAPI::fetch(const std::string& url) {
+    ///          FB::PromiseCallsite site("MyAPI::fetch");
+    ///          ...
+    ///      }
+    /// @endcode
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    class PromiseCallsite final
+    {
+    public:
+#ifdef FB_DEFERRED_INSTRUMENTATION
+        explicit PromiseCallsite(const char* name);
+        ~PromiseCallsite();
+#else
+        explicit PromiseCallsite(const char*) {}
+#endif
+
+    private:
+        PromiseCallsite(const PromiseCallsite&) = delete;
+        PromiseCallsite& operator=(const PromiseCallsite&) = delete;
+
+#ifdef FB_DEFERRED_INSTRUMENTATION
+        detail::callsite_stats* m_previous;
+#endif
+    };
+
+}
+
+#endif // H_FBPROMISESTATS
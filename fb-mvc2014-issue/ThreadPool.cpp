@@ -0,0 +1,189 @@
+/**********************************************************\
+Created:    Oct 15, 2026
+License:    Dual license model; choose one of two:
+            New BSD License
+            http://www.opensource.org/licenses/bsd-license.php
+            - or -
+            GNU Lesser General Public License, version 2.1
+            http://www.gnu.org/licenses/lgpl-2.1.html
+
+Copyright 2026 the FireBreath Dev Team
+\**********************************************************/
+
+#include "ThreadPool.h"
+#include "precompiled_headers.h" // On windows, everything above this line in PCH
+
+using namespace FB;
+
+namespace {
+    // The pool (its Core) and worker the current thread belongs to, if any
+    thread_local const void* t_pool = nullptr;
+    thread_local std::size_t t_index = 0;
+}
+
+ThreadPool::ThreadPool(std::size_t threadCount) {
+    if (!threadCount) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    if (!threadCount) {
+        threadCount = 1;
+    }
+    m_core = std::make_shared<Core>(threadCount);
+    // only start the threads once every deque exists, since they steal from each other
+    for (std::size_t i = 0; i < threadCount; ++i) {
+        std::shared_ptr<Core> core(m_core);
+        m_core->workers[i]->thread = std::thread([core, i]() { core->run(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_core->sleepMutex);
+        m_core->stop = true;
+    }
+    m_core->wake.notify_all();
+    for (auto& worker : m_core->workers) {
+        if (worker->thread.get_id() == std::this_thread::get_id()) {
+            // a task on this worker dropped the last reference; it finishes on its own
+            worker->thread.detach();
+        } else if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+void ThreadPool::execute(Task task) {
+    Core& core = *m_core;
+    if (t_pool == &core) {
+        core.push(*core.workers[t_index], std::move(task), true);
+    } else {
+        std::size_t index = core.nextWorker.fetch_add(1, std::memory_order_relaxed) % core.workers.size();
+        core.push(*core.workers[index], std::move(task), false);
+    }
+}
+
+std::vector<ThreadPool::WorkerStats> ThreadPool::stats() const {
+    std::vector<WorkerStats> result;
+    result.reserve(m_core->workers.size());
+    for (const auto& worker : m_core->workers) {
+        WorkerStats stats = {
+            worker->executed.load(std::memory_order_relaxed),
+            worker->stolen.load(std::memory_order_relaxed),
+            worker->stealMisses.load(std::memory_order_relaxed),
+            worker->sleeps.load(std::memory_order_relaxed),
+            worker->exceptions.load(std::memory_order_relaxed)
+        };
+        result.push_back(stats);
+    }
+    return result;
+}
+
+ThreadPool::Core::Core(std::size_t threadCount)
+    : nextWorker(0), pending(0), sleeping(0), stop(false) {
+    workers.reserve(threadCount);
+    for (std::size_t i = 0; i < threadCount; ++i) {
+        std::unique_ptr<Worker> worker(new Worker);
+        worker->executed = 0;
+        worker->stolen = 0;
+        worker->stealMisses = 0;
+        worker->sleeps = 0;
+        worker->exceptions = 0;
+        workers.emplace_back(std::move(worker));
+    }
+}
+
+void ThreadPool::Core::push(Worker& worker, Task task, bool local) {
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        // a continuation of the running task goes first, while its data is hot; work from outside
+        // waits its turn behind what was submitted before it
+        if (local) {
+            worker.tasks.emplace_front(std::move(task));
+        } else {
+            worker.tasks.emplace_back(std::move(task));
+        }
+    }
+    // A worker going to sleep registers in sleeping before it checks pending, and we bump
+    // pending before checking sleeping, so one of us always sees the other
+    pending.fetch_add(1);
+    if (sleeping.load()) {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        wake.notify_one();
+    }
+}
+
+bool ThreadPool::Core::popLocal(Worker& worker, Task& task) {
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty()) {
+        return false;
+    }
+    task = std::move(worker.tasks.front());
+    worker.tasks.pop_front();
+    return true;
+}
+
+bool ThreadPool::Core::steal(std::size_t thief, Task& task) {
+    const std::size_t count = workers.size();
+    // start at a different sibling each time so thieves don't all pile onto the same victim
+    const std::size_t start = thief + 1 + static_cast<std::size_t>(workers[thief]->stealMisses.load(std::memory_order_relaxed));
+    for (std::size_t i = 0; i < count; ++i) {
+        const std::size_t victim = (start + i) % count;
+        if (victim == thief) {
+            continue;
+        }
+        Worker& worker = *workers[victim];
+        std::unique_lock<std::mutex> lock(worker.mutex, std::try_to_lock);
+        if (!lock.owns_lock() || worker.tasks.empty()) {
+            continue;
+        }
+        task = std::move(worker.tasks.back());
+        worker.tasks.pop_back();
+        return true;
+    }
+    workers[thief]->stealMisses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void ThreadPool::Core::run(std::size_t index) {
+    t_pool = this;
+    t_index = index;
+    Worker& self = *workers[index];
+    for (;;) {
+        Task task;
+        bool stolen = false;
+        if (!popLocal(self, task)) {
+            stolen = steal(index, task);
+        }
+        if (task) {
+            pending.fetch_sub(1);
+            try {
+                task();
+            } catch (...) {
+                self.exceptions.fetch_add(1, std::memory_order_relaxed);
+            }
+            self.executed.fetch_add(1, std::memory_order_relaxed);
+            if (stolen) {
+                self.stolen.fetch_add(1, std::memory_order_relaxed);
+            }
+            continue;
+        }
+
+        if (pending.load()) {
+            // a task is queued but we lost the race for it (or a victim was busy); look again
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleeping.fetch_add(1);
+        if (!pending.load() && !stop.load()) {
+            self.sleeps.fetch_add(1, std::memory_order_relaxed);
+            wake.wait(lock, [this]() { return pending.load() || stop.load(); });
+        }
+        sleeping.fetch_sub(1);
+        if (stop.load() && !pending.load()) {
+            break;
+        }
+    }
+    t_pool = nullptr;
+}
@@ -0,0 +1,148 @@
+/**********************************************************\
+Created:    Oct 15, 2026
+License:    Dual license model; choose one of two:
+            New BSD License
+            http://www.opensource.org/licenses/bsd-license.php
+            - or -
+            GNU Lesser General Public License, version 2.1
+            http://www.gnu.org/licenses/lgpl-2.1.html
+
+Copyright 2026 the FireBreath Dev Team
+\**********************************************************/
+
+#pragma once
+#ifndef H_FBTHREADPOOL
+#define H_FBTHREADPOOL
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "Deferred.h"
+#include "Executor.h"
+
+namespace FB {
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @class  ThreadPool
+    ///
+    /// @brief  Work-stealing thread pool; an FB::Executor, so it can be passed to Promise::done,
+    ///         then and thenPipe.
+    ///
+    /// Every worker has its own deque.  Work submitted from a worker thread (typically a
+    /// continuation scheduled by a task which is running on the pool) goes to the front of that
+    /// worker's deque and is picked up from there first, while it is still hot in the cache; work
+    /// from any other thread is spread over the workers round robin and queued at the back, so each
+    /// worker runs it in the order it arrived.  A worker which runs out of work steals from the back
+    /// of one of its siblings' deques before going to sleep.
+    ///
+    /// @code
+    ///      auto pool = std::make_shared<FB::ThreadPool>();
+    ///      FB::Promise<int> answer = pool->submit([]() { return 6 * 7; });
+    ///      answer.done([](int v) { ... }, nullptr, pool);   // the handler runs on the pool too
+    /// @endcode
+    ///
+    /// Destroying the pool runs everything which was already submitted, then joins the workers.
+    /// Nothing may be submitted once destruction has started.  The last reference may be dropped
+    /// by a task running on the pool (e.g. a handler which held the ExecutorPtr); that worker can't
+    /// join itself, so it is detached instead and finishes what is left after the destructor returns.
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    class ThreadPool final : public Executor
+    {
+    public:
+        /// @brief Counters for one worker; see ThreadPool::stats()
+        struct WorkerStats {
+            std::uint64_t executed;     // tasks run by this worker
+            std::uint64_t stolen;       // ... of which were taken from another worker's deque
+            std::uint64_t stealMisses;  // passes over the other workers which found nothing
+            std::uint64_t sleeps;       // times the worker went to sleep for lack of work
+            std::uint64_t exceptions;   // tasks which ended with an exception (it is discarded)
+        };
+
+        /// @brief Starts threadCount workers (std::thread::hardware_concurrency() if 0)
+        explicit ThreadPool(std::size_t threadCount = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /// @brief Queues task to run on one of the workers
+        void execute(Task task) override;
+
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        /// @fn template <typename F> Promise<R> ThreadPool::submit(F&& fn)
+        ///
+        /// @brief  Runs fn on the pool and returns a Promise for its result.  If fn throws the
+        ///         Promise is rejected with that exception.
+        ///
+        /// fn may be move-only; it is moved into the task and never copied.
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        template <typename F>
+        Promise<typename std::decay<decltype(std::declval<F&>()())>::type> submit(F&& fn) {
+            using R = typename std::decay<decltype(std::declval<F&>()())>::type;
+            static_assert(!std::is_void<R>::value, "ThreadPool::submit: fn must return a value for the Promise");
+            Deferred<R> dfd;
+            Promise<R> promise(dfd.promise());
+            execute(Task([dfd, fn = std::forward<F>(fn)]() mutable {
+                try {
+                    dfd.resolve(fn());
+                } catch (...) {
+                    dfd.reject(std::current_exception());
+                }
+            }));
+            return promise;
+        }
+
+        /// @brief Returns the number of workers
+        std::size_t size() const { return m_core->workers.size(); }
+
+        /// @brief Returns a snapshot of the counters of every worker; they are updated without
+        /// synchronization, so a snapshot taken while the pool is busy is only approximate
+        std::vector<WorkerStats> stats() const;
+
+    private:
+        struct Worker {
+            std::mutex mutex;
+            std::deque<Task> tasks;     // the owner works at the front, thieves take from the back;
+                                        // local work is pushed at the front, outside work at the back
+            std::thread thread;
+
+            std::atomic<std::uint64_t> executed;
+            std::atomic<std::uint64_t> stolen;
+            std::atomic<std::uint64_t> stealMisses;
+            std::atomic<std::uint64_t> sleeps;
+            std::atomic<std::uint64_t> exceptions;
+        };
+
+        // Everything the workers use.  Every worker thread holds a reference to it, so one which
+        // destroys the pool (see above) can still finish its loop after ~ThreadPool has returned.
+        struct Core {
+            explicit Core(std::size_t threadCount);
+
+            void run(std::size_t index);
+            bool popLocal(Worker& worker, Task& task);
+            bool steal(std::size_t thief, Task& task);
+            void push(Worker& worker, Task task, bool local);
+
+            std::vector<std::unique_ptr<Worker>> workers;
+            std::atomic<std::size_t> nextWorker;
+
+            // Tasks which have been pushed and not yet popped; workers sleep only while this is 0
+            std::atomic<std::size_t> pending;
+            std::atomic<std::size_t> sleeping;
+            std::atomic<bool> stop;
+            std::mutex sleepMutex;
+            std::condition_variable wake;
+        };
+
+        std::shared_ptr<Core> m_core;
+    };
+
+}
+
+#endif // H_FBTHREADPOOL
@@ -0,0 +1,104 @@
+/**********************************************************\
+Created:    Oct 15, 2026
+License:    Dual license model; choose one of two:
+            New BSD License
+            http://www.opensource.org/licenses/bsd-license.php
+            - or -
+            GNU Lesser General Public License, version 2.1
+            http://www.gnu.org/licenses/lgpl-2.1.html
+
+Copyright 2026 Firebreath development team
+\**********************************************************/
+
+#pragma once
+#ifndef H_FB_UTIL_BLOCK_CACHE
+#define H_FB_UTIL_BLOCK_CACHE
+
+#include <cstddef>
+#include <new>
+
+namespace FB { namespace detail {
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @class  block_cache
+    ///
+    /// @brief  Per-thread free list of fixed size memory blocks, for objects which are created and
+    ///         destroyed at a high rate (e.g. the shared state of FB::Deferred).
+    ///
+    /// Freed blocks are kept by the thread which frees them, up to MaxCached of them, and handed out
+    /// again by allocate() on that thread without touching the global heap or taking a lock.  A
+    /// block may be freed on a different thread than the one which allocated it; it simply joins
+    /// the other thread's cache.  Whatever a thread still has cached is returned to the heap when
+    /// the thread exits.
+    ///
+    /// Blocks come from ::operator new, so they have the alignment of std::max_align_t.
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    template <std::size_t Size, std::size_t MaxCached = 128>
+    class block_cache
+    {
+    public:
+        static void* allocate() {
+            cache& c = local();
+            if (c.head) {
+                free_block* block = c.head;
+                c.head = block->next;
+                --c.count;
+                return block;
+            }
+            return ::operator new(block_size);
+        }
+
+        static void deallocate(void* p) {
+            cache& c = local();
+            if (c.closed || c.count >= MaxCached) {
+                ::operator delete(p);
+                return;
+            }
+            if (!c.head && !c.count) {
+                register_thread_exit();
+            }
+            free_block* block = static_cast<free_block*>(p);
+            block->next = c.head;
+            c.head = block;
+            ++c.count;
+        }
+
+    private:
+        struct free_block {
+            free_block* next;
+        };
+        static const std::size_t block_size = Size < sizeof(free_block) ? sizeof(free_block) : Size;
+
+        // Plain data so that it is usable at any point during thread exit, even after the reaper
+        // below has run (blocks freed after that go straight back to the heap)
+        struct cache {
+            free_block* head;
+            std::size_t count;
+            bool closed;
+        };
+        static cache& local() {
+            static thread_local cache c;   // zero initialized
+            return c;
+        }
+
+        struct reaper {
+            ~reaper() {
+                cache& c = local();
+                c.closed = true;
+                while (c.head) {
+                    free_block* next = c.head->next;
+                    ::operator delete(c.head);
+                    c.head = next;
+                }
+                c.count = 0;
+            }
+        };
+        static void register_thread_exit() {
+            static thread_local reaper r;
+            (void)r;
+        }
+    };
+
+} }
+
+#endif // H_FB_UTIL_BLOCK_CACHE
@@ -0,0 +1,364 @@
+/**********************************************************\
+Created:    Oct 15, 2026
+License:    Dual license model; choose one of two:
+            New BSD License
+            http://www.opensource.org/licenses/bsd-license.php
+            - or -
+            GNU Lesser General Public License, version 2.1
+            http://www.gnu.org/licenses/lgpl-2.1.html
+
+Copyright 2026 Firebreath development team
+\**********************************************************/
+
+#pragma once
+#ifndef H_FB_UTIL_CHARCONV
+#define H_FB_UTIL_CHARCONV
+
+#include <cerrno>
+#include <clocale>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <locale>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <type_traits>
+
+namespace FB { namespace detail {
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @struct from_chars_result
+    ///
+    /// @brief  Result of FB::detail::from_chars; ptr points at the first character not consumed
+    ///         and ec is std::errc() on success
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    template <typename Char>
+    struct from_chars_result {
+        const Char* ptr;
+        std::errc ec;
+    };
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @struct to_chars_result
+    ///
+    /// @brief  Result of FB::detail::to_chars; ptr is one past the last character written and ec is
+    ///         std::errc::value_too_large if the buffer was too small
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    struct to_chars_result {
+        char* ptr;
+        std::errc ec;
+    };
+
+    /// @brief  A buffer of this size is always large enough for to_chars of any arithmetic type
+    static const std::size_t to_chars_max_size = 64;
+
+    namespace charconv_impl {
+        template <typename Char>
+        inline bool is_digit(Char c) {
+            return c >= Char('0') && c <= Char('9');
+        }
+
+        template <typename Char>
+        inline from_chars_result<Char> result(const Char* ptr, std::errc ec) {
+            from_chars_result<Char> res = { ptr, ec };
+            return res;
+        }
+
+        // Exact powers of ten; 1e22 is the largest one a double represents exactly
+        inline double pow10(int e) {
+            static const double table[] = {
+                1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+            };
+            return table[e];
+        }
+
+        // Limits within which mantissa * 10^exp can be computed with a single rounding
+        template <typename T>
+        struct fast_path {
+            static const int max_exponent = 22;
+            static const std::uint64_t max_mantissa = std::uint64_t(1) << 53;
+        };
+        template <>
+        struct fast_path<float> {
+            static const int max_exponent = 10;
+            static const std::uint64_t max_mantissa = std::uint64_t(1) << 24;
+        };
+
+        inline double parse_back(const char* str, double) {
+            return std::strtod(str, nullptr);
+        }
+        inline float parse_back(const char* str, float) {
+            return std::strtof(str, nullptr);
+        }
+
+        // Slow path for floating point values outside the fast path.  Only digits, signs, '.' and
+        // 'e' get here, so the input is copied to a buffer on the stack (with the C locale's decimal
+        // point, which is what strtod expects) and narrowing wchar_t is safe.  Input too long for the
+        // buffer, i.e. hundreds of digits, goes to a classic-locale stream, which allocates.
+        // Underflow reads as the nearest denormal or zero; overflow fails.
+        template <typename T, typename Char>
+        bool parse_float_slow(const Char* first, const Char* last, T& value) {
+            char buf[128];
+            if (last - first >= static_cast<std::ptrdiff_t>(sizeof(buf))) {
+                std::string narrow(first, last);
+                std::istringstream iss(narrow);
+                iss.imbue(std::locale::classic());
+                return static_cast<bool>(iss >> value);
+            }
+            const char point = *std::localeconv()->decimal_point;
+            char* out = buf;
+            for (; first != last; ++first) {
+                *out++ = *first == Char('.') ? point : static_cast<char>(*first);
+            }
+            *out = '\0';
+            errno = 0;
+            const T v = parse_back(buf, T());
+            if (errno == ERANGE && (v == std::numeric_limits<T>::infinity() || v == -std::numeric_limits<T>::infinity())) {
+                return false;
+            }
+            value = v;
+            return true;
+        }
+
+        inline to_chars_result to_result(char* ptr, std::errc ec) {
+            to_chars_result res = { ptr, ec };
+            return res;
+        }
+
+        // Formats with the fewest significant digits (at most maxDigits, which always suffices) that
+        // read back as the same value; %g trims trailing zeros, so the first precision that
+        // round-trips is also the shortest representation.  Integers below 10^fixedDigits are then
+        // written out in full (100 rather than 1e+02); they are exactly representable, so the extra
+        // digits are the value's own.  printf/strtod agree on the C locale's decimal point, which is
+        // then replaced with '.' so the output is locale independent.
+        template <typename T>
+        to_chars_result format_shortest(char* first, char* last, T value, int fixedDigits, int maxDigits) {
+            char buf[to_chars_max_size];
+            int len = 0;
+            int digits = 1;
+            for (; digits <= maxDigits; ++digits) {
+                len = std::snprintf(buf, sizeof(buf), "%.*g", digits, static_cast<double>(value));
+                if (value != value || parse_back(buf, value) == value) {
+                    break;
+                }
+            }
+            const char* exp = len > 0 ? std::strchr(buf, 'e') : nullptr;
+            if (exp) {
+                const int exponent = std::atoi(exp + 1);
+                if (exponent >= digits && exponent < fixedDigits) {
+                    len = std::snprintf(buf, sizeof(buf), "%.*g", exponent + 1, static_cast<double>(value));
+                }
+            }
+            if (len < 0 || len > last - first) {
+                return to_result(last, std::errc::value_too_large);
+            }
+            const char point = *std::localeconv()->decimal_point;
+            for (int i = 0; i < len; ++i) {
+                first[i] = buf[i] == point ? '.' : buf[i];
+            }
+            return to_result(first + len, std::errc());
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @fn template <typename Char, typename T> from_chars_result<Char> from_chars(const Char* first, const Char* last, T& value)
+    ///
+    /// @brief  Parses an integer from [first, last) in the manner of C++17 std::from_chars: no leading
+    ///         whitespace or '+' is accepted, '-' only for signed types, and nothing is allocated.
+    ///         Works on char and wchar_t input.
+    ///
+    /// @return ec is std::errc::invalid_argument if there are no digits and
+    ///         std::errc::result_out_of_range if the value doesn't fit in T (value is unchanged)
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    template <typename Char, typename T>
+    typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, from_chars_result<Char> >::type
+    from_chars(const Char* first, const Char* last, T& value) {
+        using namespace charconv_impl;
+        typedef typename std::make_unsigned<T>::type U;
+        const Char* p = first;
+        bool negative = false;
+        if (std::is_signed<T>::value && p != last && *p == Char('-')) {
+            negative = true;
+            ++p;
+        }
+        if (p == last || !is_digit(*p)) {
+            return result(first, std::errc::invalid_argument);
+        }
+        // the magnitude of min() is max() + 1 for signed types
+        const U limit = negative
+            ? static_cast<U>(static_cast<U>(std::numeric_limits<T>::max()) + 1u)
+            : static_cast<U>(std::numeric_limits<T>::max());
+        U acc = 0;
+        bool overflow = false;
+        for (; p != last && is_digit(*p); ++p) {
+            U digit = static_cast<U>(*p - Char('0'));
+            if (acc > (limit - digit) / 10) {
+                overflow = true;
+            } else {
+                acc = static_cast<U>(acc * 10 + digit);
+            }
+        }
+        if (overflow) {
+            return result(p, std::errc::result_out_of_range);
+        }
+        value = negative ? static_cast<T>(0 - acc) : static_cast<T>(acc);
+        return result(p, std::errc());
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @fn template <typename Char, typename T> from_chars_result<Char> from_chars(const Char* first, const Char* last, T& value)
+    ///
+    /// @brief  Parses a decimal floating point value ([-]digits[.digits][e[+-]digits]) from
+    ///         [first, last), independent of the current locale.
+    ///
+    /// Values with at most 15-19 significant digits and a small exponent (the vast majority of what
+    /// we get from javascript) are computed exactly; anything else is handed to strtod.  Nothing is
+    /// allocated unless the number is over a hundred characters long.  Overflow is reported as
+    /// std::errc::result_out_of_range; underflow gives the nearest denormal or zero.
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    template <typename Char, typename T>
+    typename std::enable_if<std::is_floating_point<T>::value, from_chars_result<Char> >::type
+    from_chars(const Char* first, const Char* last, T& value) {
+        using namespace charconv_impl;
+        const Char* p = first;
+        bool negative = false;
+        if (p != last && *p == Char('-')) {
+            negative = true;
+            ++p;
+        }
+        std::uint64_t mantissa = 0;
+        int digits = 0;         // significant digits kept in mantissa
+        int exponent = 0;       // power of ten to apply to mantissa
+        bool any = false;
+        bool truncated = false;
+        for (; p != last && is_digit(*p); ++p) {
+            any = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + static_cast<unsigned>(*p - Char('0'));
+                if (mantissa) {
+                    ++digits;
+                }
+            } else {
+                ++exponent;
+                truncated = truncated || *p != Char('0');
+            }
+        }
+        if (p != last && *p == Char('.')) {
+            ++p;
+            for (; p != last && is_digit(*p); ++p) {
+                any = true;
+                if (digits < 19) {
+                    mantissa = mantissa * 10 + static_cast<unsigned>(*p - Char('0'));
+                    if (mantissa) {
+                        ++digits;
+                    }
+                    --exponent;
+                } else {
+                    truncated = truncated || *p != Char('0');
+                }
+            }
+        }
+        if (!any) {
+            return result(first, std::errc::invalid_argument);
+        }
+        if (p != last && (*p == Char('e') || *p == Char('E'))) {
+            const Char* e = p + 1;
+            bool negExp = false;
+            if (e != last && (*e == Char('-') || *e == Char('+'))) {
+                negExp = *e == Char('-');
+                ++e;
+            }
+            if (e != last && is_digit(*e)) {
+                int exp = 0;
+                for (; e != last && is_digit(*e); ++e) {
+                    if (exp < 100000) {
+                        exp = exp * 10 + (*e - Char('0'));
+                    }
+                }
+                exponent += negExp ? -exp : exp;
+                p = e;
+            }
+        }
+
+        if (!truncated && mantissa <= fast_path<T>::max_mantissa &&
+            exponent >= -fast_path<T>::max_exponent && exponent <= fast_path<T>::max_exponent) {
+            T v = static_cast<T>(mantissa);
+            if (exponent < 0) {
+                v /= static_cast<T>(pow10(-exponent));
+            } else {
+                v *= static_cast<T>(pow10(exponent));
+            }
+            value = negative ? -v : v;
+            return result(p, std::errc());
+        }
+        if (mantissa == 0 && !truncated) {
+            value = negative ? -T(0) : T(0);
+            return result(p, std::errc());
+        }
+
+        T v;
+        if (!parse_float_slow(first, p, v)) {
+            return result(p, std::errc::result_out_of_range);
+        }
+        value = v;
+        return result(p, std::errc());
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @fn template <typename T> to_chars_result to_chars(char* first, char* last, T value)
+    ///
+    /// @brief  Writes the decimal form of an integer into [first, last) without allocating, in the
+    ///         manner of C++17 std::to_chars.  No terminating null is written.
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, to_chars_result>::type
+    to_chars(char* first, char* last, T value) {
+        typedef typename std::make_unsigned<T>::type U;
+        char buf[std::numeric_limits<U>::digits10 + 2];
+        char* p = buf + sizeof(buf);
+        const bool negative = value < 0;
+        U mag = negative ? static_cast<U>(0 - static_cast<U>(value)) : static_cast<U>(value);
+        do {
+            *--p = static_cast<char>('0' + mag % 10);
+            mag = static_cast<U>(mag / 10);
+        } while (mag);
+        if (negative) {
+            *--p = '-';
+        }
+        const std::ptrdiff_t len = buf + sizeof(buf) - p;
+        if (len > last - first) {
+            return charconv_impl::to_result(last, std::errc::value_too_large);
+        }
+        for (std::ptrdiff_t i = 0; i < len; ++i) {
+            first[i] = p[i];
+        }
+        return charconv_impl::to_result(first + len, std::errc());
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @fn to_chars_result to_chars(char* first, char* last, double value)
+    ///
+    /// @brief  Writes the shortest representation of value that parses back to the same double,
+    ///         using '.' as the decimal point regardless of locale (e.g. 0.1, 5e-324).  Large and
+    ///         small magnitudes use exponent notation as printf's %g does (e.g. 1e+20); integers
+    ///         of up to digits10 digits never do (e.g. 100).
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    inline to_chars_result to_chars(char* first, char* last, double value) {
+        return charconv_impl::format_shortest(first, last, value, std::numeric_limits<double>::digits10,
+                                              std::numeric_limits<double>::max_digits10);
+    }
+
+    /// @brief  Shortest round trip representation of a float; see to_chars(char*, char*, double)
+    inline to_chars_result to_chars(char* first, char* last, float value) {
+        return charconv_impl::format_shortest(first, last, value, std::numeric_limits<float>::digits10,
+                                              std::numeric_limits<float>::max_digits10);
+    }
+
+} }
+
+#endif // H_FB_UTIL_CHARCONV
@@ -0,0 +1,242 @@
+/**********************************************************\
+Created:    Oct 15, 2026
+License:    Dual license model; choose one of two:
+            New BSD License
+            http://www.opensource.org/licenses/bsd-license.php
+            - or -
+            GNU Lesser General Public License, version 2.1
+            http://www.gnu.org/licenses/lgpl-2.1.html
+
+Copyright 2026 Firebreath development team
+\**********************************************************/
+
+#pragma once
+#ifndef H_FB_UTIL_UNIQUE_FUNCTION
+#define H_FB_UTIL_UNIQUE_FUNCTION
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace FB {
+
+    template <typename Signature>
+    class unique_function;
+
+    namespace detail {
+        // Same idea as FB::variant_detail::storage: callables which fit are kept in place, anything
+        // else is boxed on the heap.  Four pointers holds a lambda capturing a couple of
+        // shared_ptrs, which covers the handlers FB::Promise creates internally.
+        static const std::size_t unique_function_size = 4 * sizeof(void*);
+        static const std::size_t unique_function_align = std::alignment_of<void*>::value > std::alignment_of<double>::value
+            ? std::alignment_of<void*>::value : std::alignment_of<double>::value;
+
+        template <typename F>
+        struct is_function_inline
+            : std::integral_constant<bool,
+                sizeof(F) <= unique_function_size &&
+                unique_function_align % std::alignment_of<F>::value == 0 &&
+                std::is_nothrow_move_constructible<F>::value> {};
+
+        // True if an F can be called with Args and what it returns converts to R (anything does
+        // for void)
+        template <typename F, typename R, typename... Args>
+        struct is_callable_as {
+            template <typename U>
+            static std::integral_constant<bool, std::is_void<R>::value ||
+                std::is_convertible<decltype(std::declval<U&>()(std::declval<Args>()...)), R>::value> test(int);
+            template <typename U>
+            static std::false_type test(...);
+            static const bool value = decltype(test<F>(0))::value;
+        };
+
+        // Empty std::functions and null function pointers make an empty unique_function
+        template <typename F>
+        bool is_null_function(const F&) {
+            return false;
+        }
+        template <typename R, typename... Args>
+        bool is_null_function(R (*f)(Args...)) {
+            return !f;
+        }
+        template <typename Sig>
+        bool is_null_function(const std::function<Sig>& f) {
+            return !f;
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @class  unique_function
+    ///
+    /// @brief  Move-only counterpart of std::function.
+    ///
+    /// Since it never has to copy its target, a unique_function can hold move-only callables (e.g.
+    /// a lambda which owns a std::unique_ptr) and moving one never copies captured state.  Small
+    /// callables are stored inline without a heap allocation.  Calling an empty unique_function
+    /// throws std::bad_function_call.
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    template <typename R, typename... Args>
+    class unique_function<R(Args...)>
+    {
+    public:
+        unique_function() noexcept : m_ops(nullptr) { }
+        unique_function(std::nullptr_t) noexcept : m_ops(nullptr) { }
+
+        template <typename F, typename = typename std::enable_if<
+            !std::is_same<typename std::decay<F>::type, unique_function>::value &&
+            detail::is_callable_as<typename std::decay<F>::type, R, Args...>::value>::type>
+        unique_function(F&& f) : m_ops(nullptr) {
+            if (!detail::is_null_function(f)) {
+                construct<typename std::decay<F>::type>(std::forward<F>(f), detail::is_function_inline<typename std::decay<F>::type>());
+            }
+        }
+
+        unique_function(unique_function&& rh) noexcept : m_ops(nullptr) {
+            rh.move_to(*this);
+        }
+        unique_function& operator=(unique_function&& rh) noexcept {
+            if (this != &rh) {
+                // rh may be owned by the current target (captured by it), so take it out before
+                // that is destroyed
+                unique_function tmp(std::move(rh));
+                swap(tmp);
+            }
+            return *this;
+        }
+        unique_function& operator=(std::nullptr_t) noexcept {
+            reset();
+            return *this;
+        }
+        template <typename F, typename = typename std::enable_if<
+            !std::is_same<typename std::decay<F>::type, unique_function>::value &&
+            detail::is_callable_as<typename std::decay<F>::type, R, Args...>::value>::type>
+        unique_function& operator=(F&& f) {
+            unique_function tmp(std::forward<F>(f));
+            return *this = std::move(tmp);
+        }
+
+        unique_function(const unique_function&) = delete;
+        unique_function& operator=(const unique_function&) = delete;
+
+        ~unique_function() {
+            reset();
+        }
+
+        explicit operator bool() const noexcept {
+            return m_ops != nullptr;
+        }
+
+        R operator()(Args... args) {
+            if (!m_ops) {
+                throw std::bad_function_call();
+            }
+            return m_ops->invoke(*this, std::forward<Args>(args)...);
+        }
+
+        void swap(unique_function& rh) noexcept {
+            if (this == &rh) {
+                return;
+            }
+            unique_function tmp;
+            move_to(tmp);
+            rh.move_to(*this);
+            tmp.move_to(rh);
+        }
+
+    private:
+        struct ops_type {
+            R (*invoke)(unique_function& self, Args&&... args);
+            void (*move)(unique_function& src, unique_function& dst);
+            void (*destroy)(unique_function& self);
+        };
+
+        template <typename F>
+        struct impl
+        {
+            static const ops_type ops;
+
+            static F& get(unique_function& self) {
+                return get(self, detail::is_function_inline<F>());
+            }
+            static F& get(unique_function& self, std::true_type) {
+                return *reinterpret_cast<F*>(&self.m_buf);
+            }
+            static F& get(unique_function& self, std::false_type) {
+                return *static_cast<F*>(self.m_ptr);
+            }
+            static R invoke(unique_function& self, Args&&... args) {
+                return static_cast<R>(get(self)(std::forward<Args>(args)...));
+            }
+            static void move(unique_function& src, unique_function& dst) {
+                move(src, dst, detail::is_function_inline<F>());
+            }
+            static void move(unique_function& src, unique_function& dst, std::true_type) {
+                new (&dst.m_buf) F(std::move(get(src)));
+                get(src).~F();
+            }
+            static void move(unique_function& src, unique_function& dst, std::false_type) {
+                dst.m_ptr = src.m_ptr;
+            }
+            static void destroy(unique_function& self) {
+                destroy(self, detail::is_function_inline<F>());
+            }
+            static void destroy(unique_function& self, std::true_type) {
+                get(self).~F();
+            }
+            static void destroy(unique_function& self, std::false_type) {
+                delete static_cast<F*>(self.m_ptr);
+            }
+        };
+
+        template <typename F, typename Arg>
+        void construct(Arg&& f, std::true_type) {
+            new (&m_buf) F(std::forward<Arg>(f));
+            m_ops = &impl<F>::ops;
+        }
+        template <typename F, typename Arg>
+        void construct(Arg&& f, std::false_type) {
+            m_ptr = new F(std::forward<Arg>(f));
+            m_ops = &impl<F>::ops;
+        }
+
+        void reset() noexcept {
+            if (m_ops) {
+                m_ops->destroy(*this);
+                m_ops = nullptr;
+            }
+        }
+
+        // Moves the target into dst, which must be empty; leaves *this empty
+        void move_to(unique_function& dst) noexcept {
+            if (m_ops) {
+                m_ops->move(*this, dst);
+                dst.m_ops = m_ops;
+                m_ops = nullptr;
+            }
+        }
+
+        union {
+            void* m_ptr;
+            typename std::aligned_storage<detail::unique_function_size, detail::unique_function_align>::type m_buf;
+        };
+        const ops_type* m_ops;
+    };
+
+    template <typename R, typename... Args>
+    template <typename F>
+    const typename unique_function<R(Args...)>::ops_type unique_function<R(Args...)>::impl<F>::ops = {
+        &unique_function<R(Args...)>::impl<F>::invoke,
+        &unique_function<R(Args...)>::impl<F>::move,
+        &unique_function<R(Args...)>::impl<F>::destroy
+    };
+
+    template <typename Signature>
+    inline void swap(unique_function<Signature>& a, unique_function<Signature>& b) noexcept {
+        a.swap(b);
+    }
+
+}
+
+#endif // H_FB_UTIL_UNIQUE_FUNCTION
@@ -0,0 +1,88 @@
+// Benchmark of converting string variants to numbers: FB::variant::convert_cast against the
+// std::istringstream it replaced.  Not part of the console project (it has its own main); build it
+// with optimizations together with variant.cpp and utf8_tools.cpp, e.g.:
+//      g++ -std=c++14 -O2 charconv_bench.cpp ../variant.cpp ../utf8_tools.cpp -o charconv_bench
+
+#include <chrono>
+#include <cstdio>
+#include <locale>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../APITypes.h"
+#include "../variant.h"
+#include "../utf8_tools.h"
+
+namespace {
+    const int Rounds = 200;
+
+    // What convert_cast used to do for a string: a classic-locale stream per conversion
+    template <typename T>
+    T streamParse(const std::string& str) {
+        std::istringstream iss(str);
+        iss.imbue(std::locale::classic());
+        T to = T();
+        iss >> to;
+        return to;
+    }
+    // ... and for a wstring, a UTF8 copy first
+    template <typename T>
+    T streamParse(const std::wstring& str) {
+        return streamParse<T>(FB::wstring_to_utf8(str));
+    }
+
+    template <typename F>
+    double nanosecondsPer(std::size_t count, F&& fn) {
+        const std::chrono::steady_clock::time_point start(std::chrono::steady_clock::now());
+        for (int round = 0; round < Rounds; ++round) {
+            fn();
+        }
+        const std::chrono::steady_clock::duration elapsed(std::chrono::steady_clock::now() - start);
+        return std::chrono::duration<double, std::nano>(elapsed).count() / (static_cast<double>(count) * Rounds);
+    }
+
+    template <typename T, typename Str>
+    void compare(const char* name, const std::vector<Str>& strings) {
+        std::vector<FB::variant> variants(strings.begin(), strings.end());
+        volatile T sink = T();
+        const double stream = nanosecondsPer(strings.size(), [&]() {
+            for (const Str& str : strings) {
+                sink = streamParse<T>(str);
+            }
+        });
+        const double variant = nanosecondsPer(variants.size(), [&]() {
+            for (const FB::variant& v : variants) {
+                sink = v.convert_cast<T>();
+            }
+        });
+        std::printf("%-26s stream %8.1f ns   convert_cast %8.1f ns   %5.1fx\n", name, stream, variant, stream / variant);
+    }
+}
+
+int main() {
+    std::vector<std::string> ints;
+    std::vector<std::string> doubles;
+    std::vector<std::string> longDoubles;
+    unsigned seed = 12345;
+    for (int i = 0; i < 1000; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        ints.push_back(std::to_string(static_cast<int>(seed >> 1) - (1 << 30)));
+        doubles.push_back(std::to_string((seed % 1000000) / 1000.0));
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.17g", static_cast<double>(seed) * 1.2345e-300);
+        longDoubles.push_back(buf);
+    }
+    std::vector<std::wstring> wideInts;
+    std::vector<std::wstring> wideDoubles;
+    for (std::size_t i = 0; i < ints.size(); ++i) {
+        wideInts.push_back(std::wstring(ints[i].begin(), ints[i].end()));
+        wideDoubles.push_back(std::wstring(doubles[i].begin(), doubles[i].end()));
+    }
+
+    compare<int>("int", ints);
+    compare<double>("double", doubles);
+    compare<double>("double (17 digits, e-3xx)", longDoubles);
+    compare<int>("int from wstring", wideInts);
+    compare<double>("double from wstring", wideDoubles);
+    return 0;
+}
@@ -0,0 +1,753 @@
+// Regression tests for FB::Promise and friends.  Not part of the console project (it has its own
+// main); build it together with the library sources, e.g.:
+//      g++ -std=c++14 -pthread promise_tests.cpp ../Deferred.cpp ../Cancellation.cpp ../Executor.cpp
+//          ../ThreadPool.cpp ../PromiseStats.cpp ../variant.cpp ../utf8_tools.cpp -o promise_tests
+// With -std=c++20 (and a compiler implementing coroutines) it tests PromiseCoroutine.h as well,
+// and with -DFB_DEFERRED_INSTRUMENTATION (on every file) the counts kept by PromiseStats.
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+#include "../APITypes.h"
+#include "../Deferred.h"
+#include "../PromiseCombinators.h"
+#include "../PromiseStats.h"
+#include "../ThreadPool.h"
+
+#if defined(__cpp_impl_coroutine)
+#include "../PromiseCoroutine.h"
+
+namespace {
+    FB::Promise<int> addOne(FB::Promise<int> input) {
+        const int v = co_await input;
+        co_return v + 1;
+    }
+    FB::Promise<int> addOneOrDefault(FB::Promise<int> input) {
+        try {
+            co_return co_await input + 1;
+        } catch (const std::runtime_error&) {
+            co_return -1;
+        }
+    }
+    FB::Promise<std::string> describe(FB::Promise<int> input) {
+        const int v = co_await addOne(std::move(input));
+        co_return std::to_string(v);
+    }
+
+    template <typename T>
+    std::string errorOf(const FB::Promise<T>& promise) {
+        try {
+            promise.get();
+        } catch (const std::exception& e) {
+            return e.what();
+        }
+        return std::string();
+    }
+
+    // co_await on Promises which are already resolved, still pending and rejected
+    void testCoroutines() {
+        FB::Promise<int> ready(addOne(FB::Promise<int>(1)));
+        assert(ready.wait_for(std::chrono::seconds(0)) == FB::PromiseState::RESOLVED && ready.get() == 2);
+
+        FB::Deferred<int> dfd;
+        FB::Promise<std::string> chained(describe(dfd.promise()));
+        assert(chained.wait_for(std::chrono::seconds(0)) == FB::PromiseState::PENDING);
+        dfd.resolve(41);
+        assert(chained.wait_for(std::chrono::seconds(0)) == FB::PromiseState::RESOLVED && chained.get() == "42");
+
+        FB::Deferred<int> failing;
+        FB::Promise<int> rethrown(addOne(failing.promise()));
+        FB::Promise<int> caught(addOneOrDefault(failing.promise()));
+        failing.reject(std::make_exception_ptr(std::runtime_error("no value")));
+        assert(rethrown.wait_for(std::chrono::seconds(0)) == FB::PromiseState::REJECTED && errorOf(rethrown) == "no value");
+        assert(caught.wait_for(std::chrono::seconds(0)) == FB::PromiseState::RESOLVED && caught.get() == -1);
+
+        FB::Promise<std::string> early(describe(FB::Promise<int>::rejected(std::make_exception_ptr(std::runtime_error("early")))));
+        assert(early.wait_for(std::chrono::seconds(0)) == FB::PromiseState::REJECTED && errorOf(early) == "early");
+    }
+}
+#endif
+
+namespace {
+    // Counts allocations made by the whole program, for the tests which check that something doesn't allocate
+    std::atomic<std::size_t> g_allocations(0);
+}
+
+void* operator new(std::size_t size) {
+    ++g_allocations;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+// Kept out of line: GCC warns about a mismatched malloc/free pair once it inlines them into code
+// which uses new
+#if defined(__GNUC__)
+#define PROMISE_TESTS_NOINLINE __attribute__((noinline))
+#else
+#define PROMISE_TESTS_NOINLINE
+#endif
+PROMISE_TESTS_NOINLINE void operator delete(void* p) noexcept {
+    std::free(p);
+}
+PROMISE_TESTS_NOINLINE void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+    // Handlers registered from several threads while others race to resolve the same Deferred:
+    // every handler runs exactly once and they all see the value of the one resolve() which won
+    // (run under ThreadSanitizer as well)
+    void testConcurrentResolveAndDone() {
+        for (int round = 0; round < 200; ++round) {
+            FB::Deferred<int> dfd;
+            FB::Promise<int> promise(dfd.promise());
+            std::atomic<int> calls(0);
+            std::atomic<int> seen(-1);
+            std::atomic<bool> mismatch(false);
+            std::vector<std::thread> threads;
+            for (int t = 0; t < 4; ++t) {
+                threads.emplace_back([&, t]() {
+                    for (int i = 0; i < 10; ++i) {
+                        promise.done([&](int v) {
+                            int expected = -1;
+                            if (!seen.compare_exchange_strong(expected, v) && expected != v) {
+                                mismatch = true;
+                            }
+                            ++calls;
+                        });
+                    }
+                    dfd.resolve(t);
+                });
+            }
+            for (std::thread& thread : threads) {
+                thread.join();
+            }
+            assert(calls == 40);
+            assert(!mismatch);
+        }
+    }
+
+    // Holds on to what it is given until run() is called
+    class QueueExecutor final : public FB::Executor
+    {
+    public:
+        void execute(FB::Task task) override {
+            tasks.push_back(std::move(task));
+        }
+        std::size_t run() {
+            std::size_t count = 0;
+            while (!tasks.empty()) {
+                FB::Task task(std::move(tasks.front()));
+                tasks.erase(tasks.begin());
+                task();
+                ++count;
+            }
+            return count;
+        }
+
+        std::vector<FB::Task> tasks;
+    };
+
+    // Handlers given an executor run where it puts them, not inside resolve() or reject()
+    void testHandlersRunOnExecutor() {
+        auto queue = std::make_shared<QueueExecutor>();
+        FB::Deferred<int> dfd;
+        FB::Promise<int> promise(dfd.promise());
+        int done = 0;
+        promise.done([&done](int v) { done = v; }, nullptr, queue);
+        FB::Promise<int> doubled(promise.then<int>([](const int& v) { return v * 2; }, nullptr, queue));
+        FB::Promise<std::string> piped(doubled.thenPipe<std::string>([](int v) { return FB::Promise<std::string>(std::to_string(v)); }, queue));
+        std::string result;
+        piped.done([&result](const std::string& v) { result = v; });
+
+        dfd.resolve(21);
+        assert(done == 0 && result.empty());
+        assert(queue->run() == 3);
+        assert(done == 21 && result == "42");
+
+        FB::Deferred<int> failing;
+        std::string error;
+        failing.promise().fail([&error](std::exception_ptr ep) {
+            try {
+                std::rethrow_exception(ep);
+            } catch (const std::exception& e) {
+                error = e.what();
+            }
+        }, queue);
+        failing.reject(std::make_exception_ptr(std::runtime_error("failed")));
+        assert(error.empty());
+        assert(queue->run() == 1 && error == "failed");
+
+        int inlined = 0;
+        FB::Promise<int>(5).done([&inlined](int v) { inlined = v; }, nullptr, FB::InlineExecutor::instance());
+        assert(inlined == 5);
+
+        // a strand on a pool never runs two of its tasks at once, and keeps them in order
+        std::vector<int> order;
+        {
+            auto pool = std::make_shared<FB::ThreadPool>(4);
+            auto strand = std::make_shared<FB::SerialExecutor>(pool);
+            std::vector<FB::Deferred<int>> inputs(200);
+            for (std::size_t i = 0; i < inputs.size(); ++i) {
+                inputs[i].promise().done([&order](int v) { order.push_back(v); }, nullptr, strand);
+            }
+            for (std::size_t i = 0; i < inputs.size(); ++i) {
+                inputs[i].resolve(static_cast<int>(i));
+            }
+            FB::Deferred<bool> finished;
+            strand->execute([finished]() { finished.resolve(true); });
+            finished.promise().wait();
+        }
+        assert(order.size() == 200);
+        for (std::size_t i = 0; i < order.size(); ++i) {
+            assert(order[i] == static_cast<int>(i));
+        }
+    }
+
+    // Counts copies of itself, to show that captured state is only ever moved
+    struct CopyCounter {
+        explicit CopyCounter(int& copies) : copies(&copies) {}
+        CopyCounter(const CopyCounter& rh) : copies(rh.copies) { ++*copies; }
+        CopyCounter(CopyCounter&& rh) noexcept : copies(rh.copies) {}
+        int* copies;
+    };
+
+    // Handlers may own move-only state; small ones are stored without allocating, and nothing
+    // they capture is copied on the way to being called
+    void testMoveOnlyHandlers() {
+        std::unique_ptr<int> owned(new int(20));
+        FB::unique_function<int(int)> add([owned = std::move(owned)](int v) { return *owned + v; });
+        FB::unique_function<int(int)> moved(std::move(add));
+        assert(!add && moved && moved(1) == 21);
+
+        int local = 3;
+        const std::size_t before = g_allocations;
+        FB::unique_function<int()> small([&local]() { return local; });
+        FB::unique_function<int()> smallMoved(std::move(small));
+        assert(g_allocations == before && smallMoved() == 3);
+
+        int copies = 0;
+        FB::Deferred<int> dfd;
+        std::weak_ptr<int> watch;
+        {
+            std::shared_ptr<int> keep(std::make_shared<int>(1));
+            watch = keep;
+            std::unique_ptr<int> big(new int(2));
+            CopyCounter counter(copies);
+            char padding[64] = {};
+            dfd.promise().done([keep = std::move(keep), big = std::move(big), counter = std::move(counter), padding](int v) {
+                assert(*keep + *big + v + padding[0] == 10);
+            });
+        }
+        assert(!watch.expired());
+        dfd.resolve(7);
+        assert(watch.expired());    // released once the handler has run
+        assert(copies == 0);
+
+        // a target may be replaced by something it owns
+        FB::unique_function<int()>* inner = nullptr;
+        FB::unique_function<int()> outer([owned = FB::unique_function<int()>([]() { return 9; }), &inner]() mutable {
+            inner = &owned;
+            return 0;
+        });
+        assert(outer() == 0);
+        outer = std::move(*inner);
+        assert(outer() == 9);
+
+        // only callables whose result converts to the return type are accepted
+        static_assert(std::is_constructible<FB::unique_function<long()>, int (*)()>::value, "int converts to long");
+        static_assert(std::is_constructible<FB::unique_function<void()>, int (*)()>::value, "anything converts to void");
+        static_assert(!std::is_constructible<FB::unique_function<int()>, void (*)()>::value, "void doesn't convert to int");
+        static_assert(!std::is_constructible<FB::unique_function<std::string()>, int (*)()>::value, "int doesn't convert to string");
+        static_assert(!std::is_assignable<FB::unique_function<int()>&, void (*)()>::value, "void doesn't convert to int");
+
+        FB::unique_function<void()> empty(static_cast<void (*)()>(nullptr));
+        assert(!empty);
+        bool threw = false;
+        try {
+            empty();
+        } catch (const std::bad_function_call&) {
+            threw = true;
+        }
+        assert(threw);
+    }
+
+    // The shared state comes from a per-thread block cache and holds its first handler in place,
+    // so once the cache is warm a Deferred with one handler doesn't reach the allocator at all
+    void testDeferredReusesStateBlocks() {
+        int sum = 0;
+        for (int i = 0; i < 2; ++i) {
+            FB::Deferred<int> warm;
+            warm.promise().done([&sum](int v) { sum += v; });
+            warm.resolve(i);
+        }
+        const std::size_t before = g_allocations;
+        for (int i = 0; i < 100; ++i) {
+            FB::Deferred<int> dfd;
+            FB::Promise<int> promise(dfd.promise());
+            FB::Deferred<int> copy(dfd);
+            promise.done([&sum](int v) { sum += v; });
+            copy.resolve(1);
+        }
+        assert(g_allocations == before);
+        assert(sum == 101);
+
+        // a long chain, one state per stage, settles all the way through
+        FB::Deferred<int> first;
+        FB::Promise<int> last(first.promise());
+        for (int i = 0; i < 1000; ++i) {
+            last = last.thenPipe<int>([](int v) { return FB::Promise<int>(v + 1); });
+        }
+        first.resolve(0);
+        assert(last.get() == 1000);
+    }
+
+    template <typename T>
+    bool isCancelled(const FB::Promise<T>& promise) {
+        try {
+            promise.get();
+        } catch (const FB::PromiseCancelled&) {
+            return true;
+        } catch (...) {
+        }
+        return false;
+    }
+
+    // Cancelling a token rejects every pending stage of a chain, skips their handlers and
+    // releases what the handlers captured
+    void testCancellation() {
+        FB::CancellationSource source;
+        FB::Deferred<int> dfd(source.token());
+        std::shared_ptr<int> captured(std::make_shared<int>(1));
+        std::weak_ptr<int> watch(captured);
+        int calls = 0;
+        FB::Promise<int> chain(dfd.promise()
+            .thenPipe<int>([captured, &calls](int v) { ++calls; return FB::Promise<int>(v + *captured); })
+            .then<int>([&calls](const int& v) { ++calls; return v * 2; }));
+        captured.reset();
+        assert(!watch.expired());
+        assert(!chain.cancellationToken().isCancelled());
+
+        source.cancel();
+        assert(watch.expired());
+        assert(dfd.cancellationToken().isCancelled());
+        assert(isCancelled(chain) && isCancelled(dfd.promise()));
+        dfd.resolve(1);     // too late; nothing runs
+        assert(calls == 0);
+
+        // a token which is already cancelled rejects right away
+        FB::Deferred<int> late(source.token());
+        assert(isCancelled(late.promise()));
+
+        // withCancellation bounds a Promise which is never going to settle by itself
+        FB::CancellationSource timeout;
+        FB::Deferred<std::string> never;
+        FB::Promise<std::string> bounded(never.promise().withCancellation(timeout.token()));
+        assert(bounded.wait_for(std::chrono::seconds(0)) == FB::PromiseState::PENDING);
+        timeout.cancel();
+        assert(isCancelled(bounded));
+    }
+
+    struct NotFound : std::runtime_error {
+        explicit NotFound(int key) : std::runtime_error("not found"), key(key) {}
+        int key;
+    };
+
+    template <typename T>
+    std::exception_ptr errorPtr(const FB::Promise<T>& promise) {
+        std::exception_ptr error;
+        promise.fail([&error](std::exception_ptr ep) { error = ep; });
+        return error;
+    }
+
+    // Whatever a handler throws rejects the next stage unchanged, and an Expected rejects it
+    // without anything being thrown
+    void testThenPipeErrors() {
+        FB::Promise<int> input(1);
+
+        FB::Promise<int> thrownInt(input.thenPipe<int>([](int) -> FB::Promise<int> { throw 42; }));
+        bool gotInt = false;
+        try {
+            std::rethrow_exception(errorPtr(thrownInt));
+        } catch (int v) {
+            gotInt = v == 42;
+        }
+        assert(gotInt);
+
+        FB::Promise<int> thrownDerived(input.thenPipe<int>([](int v) -> FB::Promise<int> { throw NotFound(v); }));
+        int key = 0;
+        try {
+            std::rethrow_exception(errorPtr(thrownDerived));
+        } catch (const NotFound& e) {
+            key = e.key;
+        }
+        assert(key == 1);
+
+        const std::exception_ptr missing(std::make_exception_ptr(NotFound(7)));
+        FB::Promise<int> unexpected(input.thenPipe<int>([&missing](int) -> FB::Expected<int> {
+            return FB::make_unexpected(missing);
+        }));
+        assert(errorPtr(unexpected) == missing);
+
+        FB::Promise<int> expected(input.thenPipe<int>([](int v) -> FB::Expected<int> { return v + 1; }));
+        assert(expected.get() == 2);
+
+        FB::Deferred<int> dfd;
+        dfd.settle(FB::make_unexpected(missing));
+        assert(errorPtr(dfd.promise()) == missing);
+    }
+
+    // then transforms the value (or the error) directly; convert_cast runs one variant
+    // conversion when the value arrives
+    void testThenAndConvertCast() {
+        FB::Deferred<int> dfd;
+        FB::Promise<std::string> text(dfd.promise().then<std::string>([](const int& v) { return std::to_string(v); }));
+        assert(text.wait_for(std::chrono::seconds(0)) == FB::PromiseState::PENDING);
+        dfd.resolve(5);
+        assert(text.get() == "5");
+
+        FB::Promise<int> recovered(FB::Promise<int>::rejected(std::make_exception_ptr(std::runtime_error("x")))
+            .then<int>(nullptr, [](std::exception_ptr) { return -1; }));
+        assert(recovered.get() == -1);
+        FB::Promise<int> noHandler(FB::Promise<int>(1).then<int>(nullptr));
+        assert(noHandler.wait_for(std::chrono::seconds(0)) == FB::PromiseState::REJECTED);
+
+        FB::Deferred<FB::variant> var;
+        FB::Promise<int> number(var.promise().convert_cast<int>());
+        FB::Promise<double> real(var.promise().convert_cast<double>());
+        var.resolve(FB::variant(std::string("12")));
+        assert(number.get() == 12 && real.get() == 12.0);
+
+        FB::Promise<std::string> fromInt(FB::Promise<int>(34).convert_cast<std::string>());
+        assert(fromInt.get() == "34");
+        FB::Promise<int> same(FB::Promise<int>(8).convert_cast<int>());
+        assert(same.get() == 8);
+
+        FB::Promise<int> bad(FB::Promise<FB::variant>(FB::variant(FB::VariantMap())).convert_cast<int>());
+        bool threw = false;
+        try {
+            bad.get();
+        } catch (const FB::bad_variant_cast&) {
+            threw = true;
+        }
+        assert(threw);
+    }
+
+    // A Promise made from a value keeps it inline: making, copying and reading one allocates
+    // nothing, and its handlers run right away
+    void testPreResolvedPromise() {
+        int seen = 0;
+        const std::size_t before = g_allocations;
+        {
+            FB::Promise<int> ready(5);
+            FB::Promise<int> copy(ready);
+            FB::Promise<int> moved(std::move(copy));
+            moved.done([&seen](int v) { seen = v; });
+            assert(seen == 5);
+            assert(ready.get() == 5 && moved.wait() == FB::PromiseState::RESOLVED);
+        }
+        assert(g_allocations == before);
+
+        FB::Promise<int> ready(6);
+        FB::Deferred<int> dfd;
+        dfd.resolve(ready);
+        assert(dfd.promise().get() == 6);
+        auto queue = std::make_shared<QueueExecutor>();
+        ready.done([&seen](int v) { seen = v; }, nullptr, queue);
+        assert(seen == 5 && queue->run() == 1 && seen == 6);
+
+        // consume gets a copy of a ready value; the Promise and its copies keep theirs
+        FB::Promise<std::vector<int>> vector(std::vector<int>(100, 7));
+        FB::Promise<std::vector<int>> vectorCopy(vector);
+        std::vector<int> taken;
+        vector.consume([&taken](std::vector<int>&& v) { taken = std::move(v); });
+        vector.consume([&taken](std::vector<int>&& v) { assert(v == taken); });
+        assert(taken == std::vector<int>(100, 7));
+        assert(vector.get() == taken && vectorCopy.get() == taken);
+    }
+
+    std::uintptr_t stackPosition() {
+        char marker = 0;
+        return reinterpret_cast<std::uintptr_t>(&marker);
+    }
+
+    // With a PromiseTrampoline every stage of a long chain runs at the same stack depth
+    void testTrampolinedChain() {
+        FB::PromiseTrampoline trampoline;
+        const int stages = 100000;
+        std::uintptr_t lowest = stackPosition();
+        std::uintptr_t highest = lowest;
+        FB::Deferred<int> first;
+        FB::Promise<int> last(first.promise());
+        for (int i = 0; i < stages; ++i) {
+            last = last.thenPipe<int>([&lowest, &highest](int v) {
+                const std::uintptr_t here = stackPosition();
+                lowest = here < lowest ? here : lowest;
+                highest = here > highest ? here : highest;
+                return FB::Promise<int>(v + 1);
+            });
+        }
+        first.resolve(0);
+        assert(last.get() == stages);
+        assert(highest - lowest < 64 * 1024);
+
+        // a resolve() from inside a handler only queues the next handlers
+        FB::Deferred<int> outer;
+        FB::Deferred<int> inner;
+        std::vector<int> order;
+        inner.promise().done([&order](int) { order.push_back(2); });
+        outer.promise().done([&order, inner](int) {
+            inner.resolve(1);
+            order.push_back(1);
+        });
+        outer.resolve(0);
+        assert(order.size() == 2 && order[0] == 1 && order[1] == 2);
+    }
+
+#ifdef FB_DEFERRED_INSTRUMENTATION
+    const FB::PromiseStatsSnapshot::Callsite* findCallsite(const FB::PromiseStatsSnapshot& stats, const std::string& name) {
+        for (const auto& site : stats.callsites) {
+            if (site.name == name) {
+                return &site;
+            }
+        }
+        return nullptr;
+    }
+
+    // Counts of states created, settled and dropped while pending, in total and per callsite
+    void testPromiseStats() {
+        const FB::PromiseStatsSnapshot before(FB::PromiseStats::snapshot());
+        assert(before.enabled);
+        {
+            FB::PromiseCallsite site("promise_tests::testPromiseStats");
+            FB::Deferred<int> resolved;
+            FB::Deferred<int> rejected;
+            FB::Deferred<int> invalidated;
+            FB::Deferred<int>* dropped = new FB::Deferred<int>();
+
+            const FB::PromiseStatsSnapshot pending(FB::PromiseStats::snapshot(1000));
+            assert(pending.pending - before.pending == 4);
+            std::size_t listed = 0;
+            for (const auto& p : pending.oldestPending) {
+                listed += p.callsite == "promise_tests::testPromiseStats";
+            }
+            assert(listed == 4);
+
+            resolved.resolve(1);
+            rejected.reject(std::make_exception_ptr(std::runtime_error("no")));
+            invalidated.invalidate();
+            delete dropped;
+        }
+        const FB::PromiseStatsSnapshot after(FB::PromiseStats::snapshot());
+        assert(after.created - before.created == 4);
+        assert(after.live == before.live && after.pending == before.pending);
+        assert(after.resolved - before.resolved == 1);
+        assert(after.rejected - before.rejected == 2);   // reject() and invalidate()
+        assert(after.invalidatedPending - before.invalidatedPending == 1);
+        assert(after.destroyedPending - before.destroyedPending == 1);
+        assert(after.resolveLatency.total() - before.resolveLatency.total() == 1);
+
+        const FB::PromiseStatsSnapshot::Callsite* site = findCallsite(after, "promise_tests::testPromiseStats");
+        assert(site && site->created == 4 && site->live == 0 && site->pending == 0 && site->destroyedPending == 1);
+    }
+#else
+    void testPromiseStats() {
+        assert(!FB::PromiseStats::enabled() && !FB::PromiseStats::snapshot().enabled);
+    }
+#endif
+
+    // Slots of a when_all over Promise<bool> are written from many threads at once; they must not
+    // share storage (run under ThreadSanitizer to see the race this guards against)
+    void testWhenAllBoolFromThreadPool() {
+        auto pool = std::make_shared<FB::ThreadPool>(4);
+        for (int round = 0; round < 100; ++round) {
+            std::vector<FB::Deferred<bool>> inputs(64);
+            std::vector<FB::Promise<bool>> promises;
+            for (const auto& dfd : inputs) {
+                promises.push_back(dfd.promise());
+            }
+            FB::Promise<std::vector<bool>> all(FB::when_all(promises));
+            for (std::size_t i = 0; i < inputs.size(); ++i) {
+                FB::Deferred<bool> dfd(inputs[i]);
+                pool->execute([dfd, i]() { dfd.resolve(i % 3 == 0); });
+            }
+            const std::vector<bool>& values = all.get();
+            assert(values.size() == inputs.size());
+            for (std::size_t i = 0; i < values.size(); ++i) {
+                assert(values[i] == (i % 3 == 0));
+            }
+        }
+    }
+
+    // Counts default constructions
+    struct DefaultCounter {
+        DefaultCounter() : value(0) { ++made; }
+        explicit DefaultCounter(int v) : value(v) {}
+        static int made;
+        int value;
+    };
+    int DefaultCounter::made = 0;
+
+    // Combinators keep each result in an optional slot, so they don't default construct values only
+    // to overwrite them
+    void testCombinatorsDontDefaultConstruct() {
+        std::vector<FB::Deferred<DefaultCounter>> inputs(3);
+        std::vector<FB::Promise<DefaultCounter>> promises;
+        for (const auto& dfd : inputs) {
+            promises.push_back(dfd.promise());
+        }
+        FB::Deferred<int> other;
+
+        int before = DefaultCounter::made;
+        FB::Promise<std::vector<FB::SettledResult<DefaultCounter>>> settled(FB::all_settled(promises));
+        assert(DefaultCounter::made == before);
+        before = DefaultCounter::made;
+        FB::Promise<std::tuple<DefaultCounter, int>> both(FB::when_all(inputs[0].promise(), other.promise()));
+        assert(DefaultCounter::made == before + 1);     // the value of the result's own Deferred
+
+        before = DefaultCounter::made;
+        inputs[0].resolve(DefaultCounter(1));
+        inputs[1].reject(std::make_exception_ptr(std::runtime_error("failed")));
+        inputs[2].resolve(DefaultCounter(3));
+        other.resolve(5);
+        assert(DefaultCounter::made == before);
+
+        const std::vector<FB::SettledResult<DefaultCounter>>& results = settled.get();
+        assert(results.size() == 3);
+        assert(results[0].state == FB::PromiseState::RESOLVED && results[0].value && results[0].value->value == 1);
+        assert(results[1].state == FB::PromiseState::REJECTED && !results[1].value && results[1].error);
+        assert(results[2].state == FB::PromiseState::RESOLVED && results[2].value && results[2].value->value == 3);
+        assert(std::get<0>(both.get()).value == 1 && std::get<1>(both.get()) == 5);
+    }
+
+    // The last listener can take a resolved VariantList over without it being copied; one with
+    // another listener after it gets a copy
+    void testConsumeTakesValueOver() {
+        FB::VariantList list(1000, FB::variant(std::string("payload")));
+        const FB::variant* buffer = list.data();
+        FB::Deferred<FB::VariantList> dfd;
+        FB::Promise<FB::VariantList> promise(dfd.promise());
+        const FB::variant* received = nullptr;
+        promise.consume([&received](FB::VariantList&& v) {
+            FB::VariantList mine(std::move(v));
+            received = mine.data();
+        });
+        dfd.resolve(std::move(list));
+        assert(received == buffer);
+
+        FB::Deferred<FB::VariantList> second;
+        const FB::VariantList* kept = nullptr;
+        second.promise().consume([&received](FB::VariantList&& v) {
+            FB::VariantList mine(std::move(v));
+            received = mine.data();
+        });
+        second.promise().done([&kept](const FB::VariantList& v) { kept = &v; });
+        second.resolve(FB::VariantList(1000, FB::variant(1)));
+        assert(kept && kept->size() == 1000 && received != kept->data());
+    }
+
+    // A consumer queued after a done() handler which runs on an executor must not move the value
+    // out from under it, whether the Promise settles before or after they are registered
+    void testConsumeAfterDoneOnPool() {
+        std::atomic<int> intact(0);
+        std::atomic<int> consumed(0);
+        {
+            auto pool = std::make_shared<FB::ThreadPool>(2);
+            for (int round = 0; round < 200; ++round) {
+                FB::Deferred<std::vector<int>> dfd;
+                FB::Promise<std::vector<int>> promise(dfd.promise());
+                const bool settleFirst = round % 2 != 0;
+                if (settleFirst) {
+                    dfd.resolve(std::vector<int>(1000, round));
+                }
+                promise.done([&intact, round](const std::vector<int>& v) {
+                    if (v.size() == 1000 && v.back() == round) {
+                        ++intact;
+                    }
+                }, nullptr, pool);
+                promise.consume([&consumed](std::vector<int>&& v) {
+                    std::vector<int> mine(std::move(v));
+                    consumed += mine.size() == 1000;
+                });
+                if (!settleFirst) {
+                    dfd.resolve(std::vector<int>(1000, round));
+                }
+            }
+        }   // the pool runs everything queued before it goes away
+        assert(intact == 200);
+        assert(consumed == 200);
+    }
+
+    // The last reference to a pool may be dropped by one of its own workers (here by the handler
+    // node holding the ExecutorPtr, released on the worker which resolved the Promise)
+    void testThreadPoolReleasedOnItsWorker() {
+        std::atomic<bool> released(false);
+        std::atomic<bool> ran(false);
+        {
+            FB::Deferred<int> dfd;
+            auto pool = std::make_shared<FB::ThreadPool>(2);
+            dfd.promise().done([&ran](int) { ran = true; }, nullptr, pool);
+            pool->execute([dfd, &released]() {
+                while (!released) {
+                    std::this_thread::yield();
+                }
+                dfd.resolve(1);
+            });
+        }
+        released = true;
+        while (!ran) {
+            std::this_thread::yield();
+        }
+    }
+
+    // wait_for() on a Promise which never settles must not add to its state every time it times out
+    void testWaitForReusesWaiter() {
+        FB::Deferred<int> dfd;
+        FB::Promise<int> promise(dfd.promise());
+        assert(promise.wait_for(std::chrono::microseconds(1)) == FB::PromiseState::PENDING);
+        const std::size_t before = g_allocations;
+        for (int i = 0; i < 1000; ++i) {
+            assert(promise.wait_for(std::chrono::microseconds(1)) == FB::PromiseState::PENDING);
+        }
+        assert(g_allocations == before);
+        dfd.resolve(7);
+        assert(promise.wait_for(std::chrono::microseconds(1)) == FB::PromiseState::RESOLVED);
+    }
+}
+
+int main() {
+    testConcurrentResolveAndDone();
+    testHandlersRunOnExecutor();
+    testMoveOnlyHandlers();
+    testDeferredReusesStateBlocks();
+    testCancellation();
+    testThenPipeErrors();
+    testThenAndConvertCast();
+    testPreResolvedPromise();
+    testTrampolinedChain();
+    testPromiseStats();
+    testWhenAllBoolFromThreadPool();
+    testCombinatorsDontDefaultConstruct();
+    testConsumeTakesValueOver();
+    testConsumeAfterDoneOnPool();
+    testThreadPoolReleasedOnItsWorker();
+    testWaitForReusesWaiter();
+#if defined(__cpp_impl_coroutine)
+    testCoroutines();
+#endif
+    puts("ok");
+    return 0;
+}
@@ -0,0 +1,421 @@
+// Regression tests for FB::variant.  Not part of the console project (it has its own main); build
+// it together with variant.cpp and utf8_tools.cpp, e.g.:
+//      g++ -std=c++14 variant_tests.cpp ../variant.cpp ../utf8_tools.cpp -o variant_tests
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <map>
+#include <set>
+#include <string>
+#include <system_error>
+#include <typeinfo>
+#include <vector>
+#include "../APITypes.h"
+#include "../variant.h"
+
+namespace {
+    struct CustomPayload {
+        int value;
+        bool operator<(const CustomPayload& rh) const { return value < rh.value; }
+        bool operator==(const CustomPayload& rh) const { return value == rh.value; }
+    };
+
+    // Names the kind of value it is called with; handles every case variant::visit requires
+    struct KindOf {
+        std::string operator()(const FB::FBVoid&) const { return "void"; }
+        std::string operator()(const FB::FBNull&) const { return "null"; }
+        std::string operator()(const bool&) const { return "bool"; }
+        std::string operator()(const std::string& v) const { return "string " + v; }
+        std::string operator()(const std::wstring&) const { return "wstring"; }
+        std::string operator()(const FB::VariantList& v) const { return "list of " + std::to_string(v.size()); }
+        std::string operator()(const FB::VariantMap& v) const { return "map of " + std::to_string(v.size()); }
+        std::string operator()(const std::exception_ptr&) const { return "exception"; }
+        std::string operator()(const FB::FBUnknownType& v) const {
+            return v.type == typeid(CustomPayload) ? "custom" : "unknown";
+        }
+        template <typename T>
+        std::string operator()(const T& v) const { return "number " + std::to_string(static_cast<long long>(v)); }
+    };
+    template <typename T>
+    bool convertFails(const FB::variant& v) {
+        try {
+            v.convert_cast<T>();
+        } catch (const FB::bad_variant_cast&) {
+            return true;
+        }
+        return false;
+    }
+
+    // convert_cast reaches the right conversion for every source type through the tag tables
+    void testConvertCastFromEachType() {
+        std::vector<FB::variant> sevens{
+            FB::variant(static_cast<char>(7)), FB::variant(static_cast<unsigned char>(7)),
+            FB::variant(static_cast<short>(7)), FB::variant(static_cast<unsigned short>(7)),
+            FB::variant(7), FB::variant(7u), FB::variant(7L), FB::variant(7UL), FB::variant(7LL),
+            FB::variant(7ULL), FB::variant(7.0f), FB::variant(7.0),
+            FB::variant(std::string("7")), FB::variant(std::wstring(L"7")),
+        };
+        for (const FB::variant& v : sevens) {
+            assert(v.convert_cast<int>() == 7);
+            assert(v.convert_cast<unsigned long long>() == 7);
+            assert(v.convert_cast<double>() == 7.0);
+            assert(v.convert_cast<float>() == 7.0f);
+        }
+        // the last two are strings, which are only true for "1", "y", "yes", "t" and "true"
+        for (std::size_t i = 0; i < sevens.size() - 2; ++i) {
+            assert(sevens[i].convert_cast<bool>());
+        }
+        assert(FB::variant(true).convert_cast<int>() == 1);
+        assert(FB::variant(false).convert_cast<double>() == 0.0);
+        assert(FB::variant(2.75).convert_cast<int>() == 2);
+        assert(FB::variant(-1).convert_cast<long long>() == -1);
+        assert(FB::variant(std::string("true")).convert_cast<bool>());
+        assert(FB::variant(std::wstring(L"Yes")).convert_cast<bool>());
+        assert(!FB::variant(std::string("7")).convert_cast<bool>());
+        assert(!FB::variant(std::string("false")).convert_cast<bool>());
+        assert(FB::variant(std::wstring(L"-3.5")).convert_cast<double>() == -3.5);
+
+        assert(convertFails<int>(FB::variant(std::string("seven"))));
+        assert(convertFails<int>(FB::variant(FB::VariantList{ FB::variant(7) })));
+        assert(convertFails<double>(FB::variant(FB::VariantMap())));
+        assert(convertFails<int>(FB::variant(std::make_exception_ptr(7))));
+    }
+
+    // convert_to writes into the caller's object, so a reused string doesn't reallocate
+    void testConvertToReusesStorage() {
+        std::string out;
+        out.reserve(64);
+        const char* buffer = out.data();
+        const FB::variant values[] = {
+            FB::variant(42), FB::variant(2.5), FB::variant(std::string("text")),
+            FB::variant(true), FB::variant(std::wstring(L"wide")),
+        };
+        const char* expected[] = { "42", "2.5", "text", "true", "wide" };
+        for (std::size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+            values[i].convert_to(out);
+            assert(out == expected[i]);
+            assert(out.data() == buffer);
+        }
+
+        bool threw = false;
+        try {
+            FB::variant(std::make_exception_ptr(1)).convert_to(out);
+        } catch (const FB::bad_variant_cast&) {
+            threw = true;
+        }
+        assert(threw && out.empty());
+
+        int number = 5;
+        FB::variant(std::string("12")).convert_to(number);
+        assert(number == 12);
+        threw = false;
+        try {
+            FB::variant(std::string("twelve")).convert_to(number);
+        } catch (const FB::bad_variant_cast&) {
+            threw = true;
+        }
+        assert(threw && number == 12);
+    }
+
+    // get_if and cref hand out the stored value itself; only cast copies
+    void testReferenceAccessors() {
+        FB::variant v(FB::VariantList(100, FB::variant(std::string("item"))));
+        const FB::variant& cv = v;
+        const FB::VariantList* list = cv.get_if<FB::VariantList>();
+        assert(list && list->size() == 100);
+        assert(&cv.cref<FB::VariantList>() == list);
+        assert(cv.cast<FB::VariantList>().data() != list->data());
+        assert(!cv.get_if<FB::VariantMap>() && !cv.get_if<std::string>());
+
+        bool threw = false;
+        try {
+            cv.cref<std::string>();
+        } catch (const FB::bad_variant_cast&) {
+            threw = true;
+        }
+        assert(threw);
+
+        v.get_if<FB::VariantList>()->push_back(FB::variant(1));
+        assert(cv.cref<FB::VariantList>().size() == 101);
+
+        FB::variant text(std::string(1000, 'x'));
+        const char* chars = text.cref<std::string>().data();
+        assert(text.get_if<std::string>()->data() == chars);
+    }
+
+    // visit dispatches on the stored type in one step, including the cases outside the known types
+    void testVisit() {
+        assert(FB::variant().visit(KindOf()) == "void");
+        assert(FB::variant(FB::FBVoid()).visit(KindOf()) == "void");
+        assert(FB::variant(FB::FBNull()).visit(KindOf()) == "null");
+        assert(FB::variant(true).visit(KindOf()) == "bool");
+        assert(FB::variant(static_cast<short>(3)).visit(KindOf()) == "number 3");
+        assert(FB::variant(-4LL).visit(KindOf()) == "number -4");
+        assert(FB::variant(2.5f).visit(KindOf()) == "number 2");
+        assert(FB::variant(std::string("s")).visit(KindOf()) == "string s");
+        assert(FB::variant(std::wstring(L"w")).visit(KindOf()) == "wstring");
+        assert(FB::variant(FB::VariantList(3)).visit(KindOf()) == "list of 3");
+        assert(FB::variant(FB::VariantMap{ { "a", FB::variant(1) } }).visit(KindOf()) == "map of 1");
+        assert(FB::variant(std::make_exception_ptr(1)).visit(KindOf()) == "exception");
+        assert(FB::variant(CustomPayload{ 1 }, true).visit(KindOf()) == "custom");
+
+        int sum = 0;
+        auto add = [&sum](const auto& v) { sum += static_cast<int>(v); };
+        const bool visitedInt = FB::variant(5).try_visit<int, double>(add);
+        const bool visitedDouble = FB::variant(2.0).try_visit<int, double>(add);
+        const bool visitedString = FB::variant(std::string("5")).try_visit<int, double>(add);
+        assert(visitedInt && visitedDouble && !visitedString);
+        assert(sum == 7);
+    }
+
+    // Move-assigning an element of a list held by the target into the target itself
+    void testSelfNestedMoveAssign() {
+        FB::VariantList inner{ FB::variant(std::string("nested")), FB::variant(2) };
+        FB::variant v(FB::VariantList{ FB::variant(inner), FB::variant(1) });
+
+        v = std::move((*v.get_if<FB::VariantList>())[0]);
+        const FB::VariantList* list = v.get_if<FB::VariantList>();
+        assert(list && list->size() == 2);
+        assert((*list)[0].convert_cast<std::string>() == "nested");
+
+        v = std::move((*v.get_if<FB::VariantList>())[0]);
+        assert(v.convert_cast<std::string>() == "nested");
+    }
+
+    // Values of different types sort by type rank (the order of FB_VARIANT_KNOWN_TYPES, numbers
+    // all together), values of one type by value
+    void testOrderingByTypeRank() {
+        const std::vector<FB::variant> sorted{
+            FB::variant(), FB::variant(FB::FBNull()), FB::variant(false), FB::variant(true),
+            FB::variant(-2.5), FB::variant(static_cast<short>(-1)), FB::variant(0u), FB::variant(3LL), FB::variant(4.5f),
+            FB::variant(std::string("a")), FB::variant(std::string("b")),
+            FB::variant(std::wstring(L"a")),
+            FB::variant(FB::VariantList{ FB::variant(1) }), FB::variant(FB::VariantList{ FB::variant(1), FB::variant(0) }),
+            FB::variant(FB::VariantMap{ { "k", FB::variant(1) } }),
+            FB::variant(CustomPayload{ 1 }, true),
+        };
+        std::vector<FB::variant> shuffled(sorted.rbegin(), sorted.rend());
+        std::swap(shuffled[1], shuffled[7]);
+        std::swap(shuffled[3], shuffled[12]);
+        std::sort(shuffled.begin(), shuffled.end());
+        assert(shuffled == sorted);
+
+        std::map<FB::variant, int> index;
+        for (std::size_t i = 0; i < sorted.size(); ++i) {
+            index[sorted[i]] = static_cast<int>(i);
+        }
+        assert(index.size() == sorted.size());
+        assert(index[FB::variant(std::string("b"))] == 10);
+        assert(index[FB::variant(3)] == 7);
+        assert(index[FB::variant(FB::FBNull())] == 1);
+    }
+
+    // emplace may be given (part of) the value it replaces
+    void testEmplaceFromOwnValue() {
+        FB::variant v(std::string(100, 'a'));
+        v.emplace<std::string>(v.cref<std::string>(), 50, 10);
+        assert(v.cref<std::string>() == std::string(10, 'a'));
+
+        FB::variant list(FB::VariantList{ FB::variant(FB::VariantList{ FB::variant(1), FB::variant(2) }), FB::variant(3) });
+        list.emplace<FB::VariantList>(list.cref<FB::VariantList>()[0].cref<FB::VariantList>());
+        assert(list.cref<FB::VariantList>().size() == 2);
+        assert(list.cref<FB::VariantList>()[1].convert_cast<int>() == 2);
+    }
+
+    // operator< and operator== agree: a == b exactly when neither is less than the other
+    void testOrderingMatchesEquality() {
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+        const double inf = std::numeric_limits<double>::infinity();
+        std::vector<FB::variant> values{
+            FB::variant(), FB::variant(FB::FBVoid()), FB::variant(FB::FBNull()),
+            FB::variant(true), FB::variant(false), FB::variant('a'),
+            FB::variant(1), FB::variant(1u), FB::variant(1.0), FB::variant(1.0f), FB::variant(1.5),
+            FB::variant(-1), FB::variant(-1LL), FB::variant(-1.5), FB::variant(0.0), FB::variant(-0.0),
+            FB::variant(0.1f), FB::variant(0.1),
+            FB::variant(static_cast<short>(2)), FB::variant(2.0f),
+            FB::variant(std::numeric_limits<long long>::min()), FB::variant(-9223372036854775808.0),
+            FB::variant(-1e19), FB::variant(std::numeric_limits<unsigned long long>::max()),
+            FB::variant(18446744073709551616.0), FB::variant(4611686018427387904.5e0),
+            FB::variant(inf), FB::variant(-inf), FB::variant(nan), FB::variant(static_cast<float>(nan)),
+            FB::variant(std::string("1")), FB::variant(std::wstring(L"1")),
+            FB::variant(FB::VariantList{ FB::variant(1) }), FB::variant(FB::VariantList{ FB::variant(1.0) }),
+            FB::variant(FB::VariantList{ FB::variant(2) }),
+        };
+        for (const FB::variant& a : values) {
+            for (const FB::variant& b : values) {
+                assert((!(a < b) && !(b < a)) == (a == b));
+                for (const FB::variant& c : values) {
+                    if (a < b && b < c) {
+                        assert(a < c);
+                    }
+                }
+            }
+        }
+
+        const std::set<FB::variant> ordered(values.begin(), values.end());
+        const FB::VariantSet hashed(values.begin(), values.end());
+        assert(ordered.size() == hashed.size());
+        assert((std::set<FB::variant>{ FB::variant(1), FB::variant(1u), FB::variant(1.0) }.size() == 1));
+    }
+
+    template <typename T, typename Char>
+    std::errc parse(const Char* str, T& value) {
+        const Char* end = str;
+        while (*end) {
+            ++end;
+        }
+        FB::detail::from_chars_result<Char> res = FB::detail::from_chars(str, end, value);
+        return res.ec;
+    }
+
+    // FB::detail::from_chars takes exactly what std::from_chars does; the variant conversions on
+    // top of it skip whitespace and a '+' like operator>> did
+    void testNumberParsing() {
+        int i = 7;
+        unsigned u = 7;
+        assert(parse("+1", i) == std::errc::invalid_argument);
+        assert(parse(" 1", i) == std::errc::invalid_argument);
+        assert(parse("-1", u) == std::errc::invalid_argument);
+        assert(parse("4294967296", u) == std::errc::result_out_of_range);
+        assert(parse("2147483648", i) == std::errc::result_out_of_range && i == 7);
+        assert(parse("-2147483648", i) == std::errc() && i == std::numeric_limits<int>::min());
+        assert(parse(L"-42", i) == std::errc() && i == -42);
+
+        double d = 0;
+        float f = 0;
+        assert(parse("inf", d) == std::errc::invalid_argument);
+        assert(parse("nan", d) == std::errc::invalid_argument);
+        assert(parse("+1.5", d) == std::errc::invalid_argument);
+        assert(parse("1e400", d) == std::errc::result_out_of_range);
+        assert(parse("-1e400", d) == std::errc::result_out_of_range);
+        assert(parse("1e39", f) == std::errc::result_out_of_range);
+        assert(parse("4.9406564584124654e-324", d) == std::errc() && d == std::numeric_limits<double>::denorm_min());
+        assert(parse("1e-400", d) == std::errc() && d == 0);
+        assert(parse(L"123.5e-1", d) == std::errc() && d == 12.35);
+        assert(parse("0.1", f) == std::errc() && f == 0.1f);
+        const std::string longOne("1" + std::string(199, '0') + "e-199");
+        assert(parse(longOne.c_str(), d) == std::errc() && d == 1.0);
+
+        assert(FB::variant(std::string(" +42")).convert_cast<int>() == 42);
+        assert(FB::variant(std::wstring(L"\t-1.5e3 apples")).convert_cast<double>() == -1500.0);
+        assert(FB::variant(std::string("18446744073709551615")).convert_cast<unsigned long long>() == 18446744073709551615ULL);
+        bool threw = false;
+        try {
+            FB::variant(std::string("-1")).convert_cast<unsigned int>();
+        } catch (const FB::bad_variant_cast&) {
+            threw = true;
+        }
+        assert(threw);
+    }
+
+    // Every finite double written with 17 significant digits reads back as itself, on the fast
+    // path and the strtod one alike
+    void testParseRoundTrip() {
+        std::vector<double> values{
+            0.1, 1.0 / 3, 1e22, 1e23, 9007199254740993.0, 123456789012345678.0,
+            std::numeric_limits<double>::max(), std::numeric_limits<double>::min(),
+            std::numeric_limits<double>::denorm_min(), 2.2250738585072009e-308,
+        };
+        std::uint64_t bits = 0x0123456789abcdefULL;
+        for (int n = 0; n < 10000; ++n) {
+            bits = bits * 6364136223846793005ULL + 1442695040888963407ULL;
+            double d;
+            std::memcpy(&d, &bits, sizeof(d));
+            if (d == d && d - d == 0) {
+                values.push_back(d);
+            }
+        }
+        for (double value : values) {
+            char buf[64];
+            std::snprintf(buf, sizeof(buf), "%.17g", value);
+            double back = 0;
+            assert(parse(buf, back) == std::errc() && back == value);
+        }
+    }
+
+    template <typename T>
+    std::string format(T value) {
+        char buf[64];
+        FB::detail::to_chars_result res = FB::detail::to_chars(buf, buf + sizeof(buf), value);
+        assert(res.ec == std::errc());
+        return std::string(buf, res.ptr);
+    }
+
+    // to_chars writes the fewest digits that read back as the same value
+    void testFormatShortest() {
+        assert(format(0.1) == "0.1");
+        assert(format(0.3) == "0.3");
+        assert(format(1.0 / 3) == "0.3333333333333333");
+        assert(format(100.0) == "100");
+        assert(format(-123000.0) == "-123000");
+        assert(format(1e14) == "100000000000000");
+        assert(format(1e15) == "1e+15");
+        assert(format(0.0) == "0");
+        assert(format(1e22) == "1e+22");
+        assert(format(1e23) == "1e+23");
+        assert(format(std::numeric_limits<double>::denorm_min()) == "5e-324");
+        assert(format(std::numeric_limits<double>::min()) == "2.2250738585072014e-308");
+        assert(format(std::numeric_limits<double>::max()) == "1.7976931348623157e+308");
+        assert(format(0.1f) == "0.1");
+        assert(format(std::numeric_limits<float>::denorm_min()) == "1e-45");
+        assert(format(16777216.0f) == "16777216");
+
+        // powers of ten, including denormal ones, take a single digit
+        for (int exp = -323; exp <= 308; ++exp) {
+            char buf[32];
+            std::snprintf(buf, sizeof(buf), "1e%d", exp);
+            double value = 0;
+            assert(parse(buf, value) == std::errc());
+            const std::string str(format(value));
+            assert(str.substr(0, str.find('e')).find_first_of("23456789") == std::string::npos);
+            double back = 0;
+            assert(parse(str.c_str(), back) == std::errc() && back == value);
+        }
+
+        // anything reads back as itself, and one digit less would not
+        std::uint64_t bits = 0xfedcba9876543210ULL;
+        for (int n = 0; n < 10000; ++n) {
+            bits = bits * 6364136223846793005ULL + 1442695040888963407ULL;
+            double d;
+            std::memcpy(&d, &bits, sizeof(d));
+            if (d != d || d - d != 0) {
+                continue;
+            }
+            const std::string str(format(d));
+            double back = 0;
+            assert(parse(str.c_str(), back) == std::errc() && back == d);
+            // significant digits: from the first to the last non-zero one before any exponent
+            const std::string mantissa(str.substr(0, str.find('e')));
+            const std::size_t firstDigit = mantissa.find_first_of("123456789");
+            const std::size_t lastDigit = mantissa.find_last_of("123456789");
+            int digits = 0;
+            for (std::size_t i = firstDigit; i <= lastDigit; ++i) {
+                digits += mantissa[i] != '.';
+            }
+            char shorter[64];
+            std::snprintf(shorter, sizeof(shorter), "%.*g", digits - 1, d);
+            assert(digits == 1 || parse(shorter, back) != std::errc() || back != d);
+        }
+    }
+}
+
+int main() {
+    testConvertCastFromEachType();
+    testConvertToReusesStorage();
+    testReferenceAccessors();
+    testVisit();
+    testSelfNestedMoveAssign();
+    testEmplaceFromOwnValue();
+    testOrderingByTypeRank();
+    testOrderingMatchesEquality();
+    testNumberParsing();
+    testParseRoundTrip();
+    testFormatShortest();
+    puts("ok");
+    return 0;
+}
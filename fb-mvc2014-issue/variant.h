@@ -17,11 +17,11 @@ Copyright 2008-2012 Richard Bateman, Firebreath development team
 //#define ANY_IMPLICIT_CASTING    // added to enable implicit casting
 
 #include <cstdint>
-#include <boost/any.hpp>
 #include <stdexcept>
 #include <typeinfo>
 #include <algorithm>
 #include <cstdlib>
+#include <cmath>
 #include <sstream>
 #include <string>
 
@@ -39,85 +39,20 @@ Copyright 2008-2012 Richard Bateman, Firebreath development team
 #include <boost/tuple/tuple.hpp>
 #include <boost/preprocessor/tuple/to_seq.hpp>
 #include <boost/logic/tribool.hpp>
+#include <boost/functional/hash.hpp>
 
 #include "APITypes.h"
 #include "Util/meta_util.h"
+#include "Util/charconv.h"
 #include "utf8_tools.h"
 #include "variant_conversions.h"
+#include "variant_storage.h"
 
 #ifdef _WIN32
 #pragma warning(push)
 #pragma warning( disable : 4800 )
 #endif
 
-#define FB_BEGIN_CONVERT_MAP(_type_) \
-    const std::type_info *type(&var.get_type()); \
-    if (*type == typeid(_type_)) { \
-    return var.cast< _type_ >(); \
-    } else
-
-#define FB_END_CONVERT_MAP(_type_) { throw bad_variant_cast(var.get_type(), typeid(_type_)); }
-#define FB_END_CONVERT_MAP_NO_THROW(_type_) {}
-
-#define FB_CONVERT_ENTRY_SIMPLE(_type_, _srctype_)             \
-    if ( *type == typeid( _srctype_ ) ) {              \
-    return static_cast< _type_ >( var.cast< _srctype_ >() );\
-    } else
-
-#define FB_CONVERT_ENTRY_COMPLEX_BEGIN(_srctype_, _var_) \
-    if (*type == typeid(_srctype_)) { \
-    _srctype_ _var_ = var.cast<_srctype_>();
-
-#define FB_CONVERT_ENTRY_COMPLEX_END() \
-    } else
-
-#define FB_CONVERT_ENTRY_NUMERIC(_type_, _srctype_) \
-    if (*type == typeid(_srctype_)) { \
-        try { \
-            return boost::numeric_cast<_type_>(var.cast<_srctype_>());\
-        } catch (const boost::numeric::bad_numeric_cast& ) { \
-            throw bad_variant_cast(var.get_type(), typeid(_type_)); \
-        } \
-    } else
-
-#define FB_CONVERT_ENTRY_FROM_WSTRING(_type_, _srctype_) \
-    if (*type == typeid(_srctype_)) { \
-        std::string __tmp = FB::wstring_to_utf8(var.cast<_srctype_>()); \
-        std::istringstream iss(__tmp); \
-        _type_ to; \
-        if (iss >> to) { \
-            return to; \
-        } else { \
-            throw bad_variant_cast(var.get_type(), typeid(_type_)); \
-        } \
-    } else
-
-#define FB_CONVERT_ENTRY_FROM_STRING(_type_, _srctype_) \
-    if (*type == typeid(_srctype_)) { \
-        typedef _srctype_::value_type char_type; \
-        std::basic_istringstream<char_type> iss(var.cast<_srctype_>()); \
-        _type_ to; \
-        if (iss >> to) { \
-            return to; \
-        } else { \
-            throw bad_variant_cast(var.get_type(), typeid(_type_)); \
-        } \
-    } else
-
-#define FB_CONVERT_ENTRY_FROM_STRING_TYPE(_type_, _srctype_) \
-    if (*type == typeid(_srctype_)) { \
-        typedef _type_::value_type char_type; \
-        std::basic_ostringstream<char_type> oss; \
-        if (oss << var.cast<_srctype_>()) { \
-            return oss.str(); \
-        } else { \
-            throw bad_variant_cast(var.get_type(), typeid(_type_)); \
-        } \
-    } else
-
-#define FB_CONVERT_ENTRY_TO_STRING(_srctype_)  FB_CONVERT_ENTRY_FROM_STRING_TYPE(std::string , _srctype_)
-#define FB_CONVERT_ENTRY_TO_WSTRING(_srctype_) FB_CONVERT_ENTRY_FROM_STRING_TYPE(std::wstring, _srctype_)
-
 namespace FB
 {
     class JSObject;
@@ -154,44 +89,93 @@ namespace FB
 
         template<typename T>
         struct lessthan {
-            static bool impl(const boost::any& l, const boost::any& r) {
-                return boost::any_cast<T>(l) < boost::any_cast<T>(r);
+            static bool impl(const storage& l, const storage& r) {
+                return l.cast<T>() < r.cast<T>();
             }
         };
 
         template<typename T>
         struct lessthan < std::weak_ptr<T> > {
-            static bool impl(const boost::any& l, const boost::any& r) {
-                return boost::any_cast<std::weak_ptr<T>>(l).owner_before(boost::any_cast<std::weak_ptr<T>>(r));
+            static bool impl(const storage& l, const storage& r) {
+                return l.cast<std::weak_ptr<T>>().owner_before(r.cast<std::weak_ptr<T>>());
             }
         };
 
         template<>
         struct lessthan < FB::FBNull > {
-            static bool impl(const boost::any& l, const boost::any& r) {
+            static bool impl(const storage& l, const storage& r) {
                 return false;
             }
         };
 
         template<>
         struct lessthan < std::exception > {
-            static bool impl(const boost::any& l, const boost::any& r) {
-                return std::string(boost::any_cast<std::exception>(l).what()) < std::string(boost::any_cast<std::exception>(r).what());
+            static bool impl(const storage& l, const storage& r) {
+                return std::string(l.cast<std::exception>().what()) < std::string(r.cast<std::exception>().what());
             }
         };
         
         template<>
         struct lessthan < std::exception_ptr > {
-            static bool impl(const boost::any& l, const boost::any& r) {
+            static bool impl(const storage& l, const storage& r) {
                 return false;
             }
         };
+
+        namespace conversion {
+            template <typename T>
+            struct converter;
+            template <typename Str>
+            struct string_appender;
+        }
+
+        template <typename Visitor, typename R>
+        struct visit_table;
+
+        struct comparison;
     } // namespace variant_detail
 
     class variant;
 
+    namespace variant_detail {
+        // Keeps the forwarding constructor / assignment of variant from being picked over the
+        // copy and move versions
+        template <typename T, typename R>
+        struct disable_for_variant
+            : std::enable_if<!std::is_same<typename std::decay<T>::type, FB::variant>::value, R> {};
+
+        template <typename... Ts>
+        struct type_list {};
+
+        // What variant::visit returns for a visitor: the result of visiting FBVoid
+        template <typename Visitor>
+        struct visit_result {
+            typedef decltype(std::declval<typename std::remove_reference<Visitor>::type&>()(
+                std::declval<const FB::variant_detail::empty&>())) type;
+        };
+
+        // Position of a type in the ordering variant::operator< uses for values of different types:
+        // the order of FB_VARIANT_KNOWN_TYPES, then all unknown types.  An empty variant is ranked as
+        // FBVoid by the caller.  The numeric types are next to each other, so ordering numbers by
+        // value among themselves keeps the ordering transitive.
+        inline unsigned type_rank(type_tag tag) {
+            return tag == type_tag::other ? static_cast<unsigned>(type_tag::count) : static_cast<unsigned>(tag);
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @struct FBUnknownType
+    ///
+    /// @brief  Passed to a variant::visit visitor when the variant holds a type which is not one of
+    ///         FB_VARIANT_KNOWN_TYPES (e.g. something stored with assign(x, true))
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    struct FBUnknownType {
+        const std::type_info& type;
+        const variant& value;
+    };
+
     template <class T>
-    variant make_variant(T);
+    variant make_variant(T&&);
 
     ////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @class  variant
@@ -225,20 +209,34 @@ namespace FB
     {
     public:
         ////////////////////////////////////////////////////////////////////////////////////////////////////
-        /// @fn template <typename T> variant::variant(const T& x)
+        /// @fn template <typename T> variant::variant(T&& x)
         ///
-        /// @brief  Templated constructor to allow any arbitrary type
+        /// @brief  Templated constructor to allow any arbitrary type; rvalues are moved into the
+        ///         variant rather than copied
         ///
         /// @param  x   The value 
         ////////////////////////////////////////////////////////////////////////////////////////////////////
         template <typename T>
-        variant(const T& x, bool) {
-            assign(x, true);
+        variant(T&& x, bool) {
+            assign(std::forward<T>(x), true);
         }
 
-        template <typename T>
-        variant(const T& x) {
-            assign(x);
+        template <typename T, typename = typename variant_detail::disable_for_variant<T, void>::type>
+        variant(T&& x) {
+            assign(std::forward<T>(x));
+        }
+
+        variant(const variant& x)
+            : object(x.object) {
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        /// @fn variant::variant(variant&& x)
+        ///
+        /// @brief  Takes over the value of x without copying it; x is left empty
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        variant(variant&& x) noexcept
+            : object(std::move(x.object)) {
         }
 
         ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -246,8 +244,7 @@ namespace FB
         ///
         /// @brief  Default constructor initializes the variant to an empty value
         ////////////////////////////////////////////////////////////////////////////////////////////////////
-        variant()
-            : lessthan(&FB::variant::lessthan_default) {
+        variant() {
         }
 
         ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -261,13 +258,27 @@ namespace FB
         ////////////////////////////////////////////////////////////////////////////////////////////////////
         variant& assign(const variant& x) {
             object = x.object;
-            lessthan = x.lessthan;
+            return *this;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        /// @fn variant& variant::assign(variant&& x)
+        ///
+        /// @brief  Moves the value out of another variant, leaving it empty
+        ///
+        /// @param  x   The variant to move from. 
+        ///
+        /// @return *this
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        variant& assign(variant&& x) noexcept {
+            object = std::move(x.object);
             return *this;
         }
 
         template<class T>
-        variant& assign(const T& x) {
-            return assign(make_variant(x));
+        typename variant_detail::disable_for_variant<T, variant&>::type
+        assign(T&& x) {
+            return assign(make_variant(std::forward<T>(x)));
             // If you get an error that there are no overloads that could convert all the argument
             // types for this line, you are trying to use a type that is not known to FireBreath.
             // First, make sure you really want to use this type! If you aren't doing this on
@@ -285,7 +296,7 @@ namespace FB
         }
 
         ////////////////////////////////////////////////////////////////////////////////////////////////////
-        /// @fn template <typename T> variant& variant::assign(const T& x, bool)
+        /// @fn template <typename T> variant& variant::assign(T&& x, bool)
         ///
         /// @brief  Assigns a value of arbitrary type
         ///
@@ -294,35 +305,100 @@ namespace FB
         /// @return *this
         ////////////////////////////////////////////////////////////////////////////////////////////////////
         template <typename T>
-        variant& assign(const T& x, bool) {
-            object = x;
-            lessthan = &FB::variant_detail::lessthan<T>::impl;
+        variant& assign(T&& x, bool) {
+            object.assign(std::forward<T>(x));
             return *this;
         }
 
-        // assignment operator 
-        template<typename T>
-        variant& operator=(T const& x) {
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        /// @fn template <typename T, typename... Args> T& variant::emplace(Args&&... args)
+        ///
+        /// @brief  Constructs a value of type T directly inside the variant from args, replacing the
+        ///         current value.  Like assign(x, true) no conversion is applied to T.
+        ///
+        /// This is the cheapest way to build nested values, since nothing is copied:
+        /// @code
+        ///      FB::variant v;
+        ///      FB::VariantList& list = v.emplace<FB::VariantList>();
+        ///      list.emplace_back(std::move(someString));
+        /// @endcode
+        ///
+        /// @return a reference to the new value
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        template <typename T, typename... Args>
+        T& emplace(Args&&... args) {
+            return object.emplace<T>(std::forward<Args>(args)...);
+        }
+
+        // assignment operators
+        variant& operator=(const variant& x) {
             return assign(x);
         }
 
+        variant& operator=(variant&& x) noexcept {
+            return assign(std::move(x));
+        }
+
+        template<typename T>
+        typename variant_detail::disable_for_variant<T, variant&>::type
+        operator=(T&& x) {
+            return assign(std::forward<T>(x));
+        }
+
         // utility functions
-        variant& swap(variant& x) {
-            std::swap(object, x.object);
-            std::swap(lessthan, x.lessthan);
+        variant& swap(variant& x) noexcept {
+            object.swap(x.object);
             return *this;
         }
 
-        // comparison function
-        bool operator<(const variant& rh) const {
-            if (get_type() == rh.get_type()) {
-                return lessthan(object, rh.object);
-            }
-            const char* left = get_type().name();
-            const char* right = rh.get_type().name();
-            return strcmp(left, right) < 0;
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        /// @fn bool variant::operator<(const variant& rh) const
+        ///
+        /// @brief  Strict weak ordering so variants can be used as keys in std::map / std::set.
+        ///
+        /// Follows the same rule as operator== (which documents it): two variants are equivalent
+        /// under < exactly when they are ==, so std::set<FB::variant> and FB::VariantSet keep the
+        /// same values.  Numbers are ordered by value whatever their type, with NaN after every other
+        /// number; otherwise values of different types are ordered by type (see
+        /// variant_detail::type_rank) and values of the same type with variant_detail::lessthan.
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        bool operator<(const variant& rh) const;
+
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        /// @fn bool variant::operator==(const variant& rh) const
+        ///
+        /// @brief  Compares two variants by value.
+        ///
+        /// Values of the same type are compared with that type's operator== (lists and maps element by
+        /// element).  Values of different types are never equal, with two exceptions:
+        ///   - an empty variant equals FBVoid
+        ///   - the numeric types short through unsigned long long, float and double compare by their
+        ///     exact mathematical value: 1 == 1u == 1.0, but 0.1f != 0.1 (the float is rounded).
+        ///     bool, char and unsigned char are not numbers for this purpose: true != 1.
+        /// All NaNs are equal to each other, so that NaN can be used as a key.  Values of unknown types
+        /// (see assign(x, true)) are equal when neither is less than the other.
+        ///
+        /// operator< agrees with this: a == b exactly when !(a < b) && !(b < a).  The one exception is
+        /// std::exception_ptr, which has no order: all of them are equivalent under <, but only the
+        /// same exception is ==.
+        ///
+        /// Equal variants always have the same hash(), so variants can be kept in FB::VariantSet and
+        /// used as keys of FB::VariantHashMap.
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        bool operator==(const variant& rh) const;
+
+        bool operator!=(const variant& rh) const {
+            return !(*this == rh);
         }
 
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        /// @fn std::size_t variant::hash() const
+        ///
+        /// @brief  Hash of the stored value, consistent with operator== (also available as
+        ///         FB::VariantHash and std::hash<FB::variant>)
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        std::size_t hash() const;
+
         ////////////////////////////////////////////////////////////////////////////////////////////////////
         /// @fn const std::type_info& variant::get_type() const
         ///
@@ -334,6 +410,18 @@ namespace FB
             return object.type();
         }
 
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        /// @fn variant_detail::type_tag variant::get_type_tag() const
+        ///
+        /// @brief  Gets the compact tag of the type stored in variant
+        ///
+        /// @return type_tag::none if empty, type_tag::other if the type is not one of
+        ///         FB_VARIANT_KNOWN_TYPES, otherwise the tag for that type
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        variant_detail::type_tag get_type_tag() const {
+            return object.tag();
+        }
+
         ////////////////////////////////////////////////////////////////////////////////////////////////////
         /// @fn template<typename T> bool variant::is_of_type() const
         ///
@@ -379,7 +467,10 @@ namespace FB
         ////////////////////////////////////////////////////////////////////////////////////////////////////
         template<typename T>
         bool is_of_type() const {
-            return (get_type() == typeid(T));
+            // known types only need their tag compared
+            return variant_detail::type_tag_of<T>::value != variant_detail::type_tag::other
+                ? object.tag() == variant_detail::type_tag_of<T>::value
+                : get_type() == typeid(T);
         }
 
         ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -394,12 +485,98 @@ namespace FB
         ////////////////////////////////////////////////////////////////////////////////////////////////////
         template<typename T>
         T cast() const {
-            if (get_type() != typeid(T)) {
+            return cref<T>();
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        /// @fn template<typename T> const T& variant::cref() const
+        ///
+        /// @brief  returns a reference to the stored value without copying it; throws
+        ///         bad_variant_cast if T is not the type of the value stored in variant
+        ///
+        /// The reference is valid until the variant is assigned to or destroyed.
+        ///
+        /// @exception  bad_variant_cast    Thrown when bad variant cast. 
+        ///
+        /// @return const reference to the stored value of type T
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        template<typename T>
+        const T& cref() const {
+            if (!is_of_type<T>()) {
                 throw bad_variant_cast(get_type(), typeid(T));
             }
-            return boost::any_cast<T>(object);
+            return object.cast<T>();
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        /// @fn template<typename T> const T* variant::get_if() const
+        ///
+        /// @brief  returns a pointer to the stored value if it is of type T, otherwise nullptr.  Never
+        ///         throws and never copies, so it is the cheapest way to inspect a variant:
+        /// @code
+        ///      if (const FB::VariantList* list = value.get_if<FB::VariantList>()) {
+        ///          // use *list
+        ///      }
+        /// @endcode
+        ///
+        /// @return pointer to the stored value or nullptr
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        template<typename T>
+        const T* get_if() const {
+            return is_of_type<T>() ? &object.cast<T>() : nullptr;
+        }
+
+        /// @brief  returns a pointer to the stored value if it is of type T, otherwise nullptr; the
+        ///         value may be modified in place through it
+        template<typename T>
+        T* get_if() {
+            return is_of_type<T>() ? &object.cast<T>() : nullptr;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        /// @fn template<typename... Ts, typename F> bool variant::try_visit(F&& f) const
+        ///
+        /// @brief  If the stored value is one of Ts, calls f with a const reference to it
+        ///
+        /// Types are checked in the order given.  f must be callable with each of Ts, e.g. a generic
+        /// lambda:
+        /// @code
+        ///      value.try_visit<std::string, FB::VariantList>([&](const auto& v) { out.write(v); });
+        /// @endcode
+        ///
+        /// @return true if f was called
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        template<typename... Ts, typename F>
+        bool try_visit(F&& f) const {
+            return try_visit_impl(f, variant_detail::type_list<Ts...>());
         }
 
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        /// @fn template<typename Visitor> auto variant::visit(Visitor&& vis) const
+        ///
+        /// @brief  Calls vis with a const reference to the stored value, dispatching once on the type
+        ///         tag through a table built for the visitor type
+        ///
+        /// The visitor must accept every type in FB_VARIANT_KNOWN_TYPES (FBVoid, FBNull, bool, every
+        /// numeric type, std::string, std::wstring, VariantList, VariantMap, std::exception_ptr) as
+        /// well as FB::FBUnknownType; a missing case is a compile error.  An empty variant is
+        /// visited as FBVoid.  Overloads may be grouped with templates:
+        /// @code
+        ///      struct Writer {
+        ///          void operator()(const FB::FBVoid&) { out << "undefined"; }
+        ///          void operator()(const FB::FBNull&) { out << "null"; }
+        ///          template <typename T> void operator()(const T& v) { ... }
+        ///      };
+        ///      value.visit(Writer());
+        /// @endcode
+        ///
+        /// @return the value returned by the visitor; the type is whatever is returned for FBVoid and
+        ///         all other cases must return something convertible to it
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        template<typename Visitor>
+        typename variant_detail::visit_result<Visitor>::type
+        visit(Visitor&& vis) const;
+
         ////////////////////////////////////////////////////////////////////////////////////////////////////
         /// @fn template<typename T> typename FB::meta::disable_for_containers<T, const T>::type variant::convert_cast() const
         ///
@@ -424,6 +601,44 @@ namespace FB
         typename FB::meta::enable_for_containers<T, Promise<T>>::type
         convert_cast() const;
 
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        /// @fn void variant::append_to(std::string& out) const
+        ///
+        /// @brief  Appends the value as text to out.  Follows the same rules as
+        ///         convert_cast<std::string>() but numbers are formatted straight into out and no
+        ///         temporary string is created, so a reused buffer avoids allocating altogether.
+        ///
+        /// @exception  bad_variant_cast    Thrown if the value can't be converted; out is left unchanged
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        void append_to(std::string& out) const;
+
+        /// @brief  Appends the value as text to out; see append_to(std::string&)
+        void append_to(std::wstring& out) const;
+
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        /// @fn template<typename T> void variant::convert_to(T& out) const
+        ///
+        /// @brief  Converts the stored value like convert_cast<T>() but stores the result in out,
+        ///         reusing its storage.  Converting a series of values into the same std::string, for
+        ///         example, only allocates when the string needs to grow:
+        /// @code
+        ///      std::string str;
+        ///      for (const FB::variant& v : list) {
+        ///          v.convert_to(str);
+        ///          // use str
+        ///      }
+        /// @endcode
+        ///
+        /// @exception  bad_variant_cast    Thrown if the conversion is not possible; strings are
+        ///                                 left empty, other types are left unchanged
+        ////////////////////////////////////////////////////////////////////////////////////////////////////
+        template<typename T>
+        typename FB::meta::disable_for_containers<T, void>::type
+        convert_to(T& out) const;
+
+        void convert_to(std::string& out) const;
+        void convert_to(std::wstring& out) const;
+
         ////////////////////////////////////////////////////////////////////////////////////////////////////
         /// @fn bool variant::empty() const
         ///
@@ -449,83 +664,405 @@ namespace FB
         }
         
     private:
+        template <typename T>
+        friend struct variant_detail::conversion::converter;
+        template <typename Str>
+        friend struct variant_detail::conversion::string_appender;
+        template <typename Visitor, typename R>
+        friend struct variant_detail::visit_table;
+        friend struct variant_detail::comparison;
+
         template<typename T>
         const T convert_cast_impl() const {
             return cast<T>();
         }
 
-        static bool lessthan_default(const boost::any& l, const boost::any& r) {
+        // Only valid after checking the type tag or type_info
+        template<typename T>
+        const T& unchecked_cast() const {
+            return object.cast<T>();
+        }
+
+        template<typename F>
+        bool try_visit_impl(F&, variant_detail::type_list<>) const {
             return false;
         }
+        template<typename F, typename T, typename... Rest>
+        bool try_visit_impl(F& f, variant_detail::type_list<T, Rest...>) const {
+            if (const T* value = get_if<T>()) {
+                f(*value);
+                return true;
+            }
+            return try_visit_impl(f, variant_detail::type_list<Rest...>());
+        }
 
         // fields
-        boost::any object;
-        bool (*lessthan)(const boost::any&, const boost::any&);
+        variant_detail::storage object;
     };
 
+    namespace variant_detail {
+        namespace conversion {
+            ///////////////////////////////////////////////////
+            // convert_cast dispatch tables
+            //
+            // Conversions to numbers, bool, std::string and
+            // std::wstring go through converter<T>, which has
+            // one entry per type_tag.  convert_cast<T>() looks
+            // up the tag of the stored value and calls the
+            // entry, so the cost doesn't depend on the type.
+            ///////////////////////////////////////////////////
+
+            struct from_number {};
+            struct from_bool {};
+            struct from_string {};
+            struct from_other {};
+
+            template <typename S>
+            struct source_kind {
+                typedef typename std::conditional<std::is_same<S, bool>::value, from_bool,
+                    typename std::conditional<std::is_arithmetic<S>::value, from_number,
+                        typename std::conditional<
+                            std::is_same<S, std::string>::value || std::is_same<S, std::wstring>::value,
+                            from_string, from_other
+                        >::type
+                    >::type
+                >::type type;
+            };
+
+            // numeric targets
+            template <typename T, typename S>
+            T to_number(const S& v, from_number) {
+                try {
+                    return boost::numeric_cast<T>(v);
+                } catch (const boost::numeric::bad_numeric_cast& ) {
+                    throw bad_variant_cast(typeid(S), typeid(T));
+                }
+            }
+            template <typename T>
+            T to_number(const bool& v, from_bool) {
+                // we handle bool here specifically because the numeric_cast produces warnings
+                return static_cast<T>(v ? 1 : 0);
+            }
+
+            template <typename Char>
+            inline const Char* skip_space(const Char* p, const Char* end) {
+                while (p != end && (*p == Char(' ') || (*p >= Char('\t') && *p <= Char('\r')))) {
+                    ++p;
+                }
+                return p;
+            }
+
+            // Reads the number at the start of the string the way operator>> on a stream does
+            // (leading whitespace and '+' are skipped, anything after the number is ignored) but
+            // without building a stream or converting wstrings to UTF8 first.
+            template <typename T, typename Char>
+            bool parse_number(const std::basic_string<Char>& str, T& to, std::false_type) {
+                const Char* p = skip_space(str.data(), str.data() + str.size());
+                const Char* end = str.data() + str.size();
+                if (p != end && *p == Char('+') && p + 1 != end && *(p + 1) != Char('-')) {
+                    ++p;
+                }
+                return FB::detail::from_chars(p, end, to).ec == std::errc();
+            }
+            // char types are read as a single character, just like operator>> does
+            template <typename T, typename Char>
+            bool parse_number(const std::basic_string<Char>& str, T& to, std::true_type) {
+                const Char* p = skip_space(str.data(), str.data() + str.size());
+                if (p == str.data() + str.size()) {
+                    return false;
+                }
+                to = static_cast<T>(*p);
+                return true;
+            }
+
+            template <typename T>
+            struct is_char_type
+                : std::integral_constant<bool,
+                    std::is_same<T, char>::value || std::is_same<T, signed char>::value ||
+                    std::is_same<T, unsigned char>::value> {};
+
+            template <typename T, typename Char>
+            T to_number(const std::basic_string<Char>& v, from_string) {
+                T to;
+                if (parse_number(v, to, is_char_type<T>())) {
+                    return to;
+                }
+                throw bad_variant_cast(typeid(std::basic_string<Char>), typeid(T));
+            }
+            template <typename T, typename S>
+            T to_number(const S&, from_other) {
+                throw bad_variant_cast(typeid(S), typeid(T));
+            }
+
+            // string targets
+            template <typename Str, typename S>
+            void append_string(Str& out, const S& v, from_number) {
+                char buf[FB::detail::to_chars_max_size];
+                FB::detail::to_chars_result res = FB::detail::to_chars(buf, buf + sizeof(buf), v);
+                if (res.ec != std::errc()) {
+                    throw bad_variant_cast(typeid(S), typeid(Str));
+                }
+                out.append(buf, res.ptr);
+            }
+            // operator<< writes char types as a character; wide streams have no overload for
+            // unsigned char, so that one prints as a number there
+            template <typename Str>
+            void append_string(Str& out, const char& v, from_number) {
+                out.push_back(static_cast<typename Str::value_type>(v));
+            }
+            inline void append_string(std::string& out, const unsigned char& v, from_number) {
+                out.push_back(static_cast<char>(v));
+            }
+            template <typename Str>
+            void append_string(Str& out, const bool& v, from_bool) {
+                const char* str = v ? "true" : "false";
+                out.append(str, str + (v ? 4 : 5));
+            }
+            inline void append_string(std::string& out, const std::string& v, from_string) {
+                out += v;
+            }
+            inline void append_string(std::wstring& out, const std::wstring& v, from_string) {
+                out += v;
+            }
+            inline void append_string(std::string& out, const std::wstring& v, from_string) {
+                out += wstring_to_utf8(v);
+            }
+            inline void append_string(std::wstring& out, const std::string& v, from_string) {
+                out += utf8_to_wstring(v);
+            }
+            template <typename Str, typename S>
+            void append_string(Str&, const S&, from_other) {
+                throw bad_variant_cast(typeid(S), typeid(Str));
+            }
+
+            // bool target
+            template <typename S, typename Kind>
+            bool to_bool(const S& v, Kind kind) {
+                return to_number<long>(v, kind) != 0;
+            }
+            inline bool to_bool(const bool& v, from_bool) {
+                return v;
+            }
+            // ASCII case insensitive comparison against a lowercase word, so the string doesn't
+            // have to be copied and lowercased first
+            template <typename Char>
+            bool equals_lowercase(const std::basic_string<Char>& str, const char* word) {
+                std::size_t i = 0;
+                for (; word[i]; ++i) {
+                    if (i == str.size()) {
+                        return false;
+                    }
+                    Char c = str[i];
+                    if (c >= Char('A') && c <= Char('Z')) {
+                        c = static_cast<Char>(c - Char('A') + Char('a'));
+                    }
+                    if (c != Char(word[i])) {
+                        return false;
+                    }
+                }
+                return i == str.size();
+            }
+            template <typename Char>
+            bool to_bool(const std::basic_string<Char>& str, from_string) {
+                return equals_lowercase(str, "y") || equals_lowercase(str, "1") || equals_lowercase(str, "yes") ||
+                    equals_lowercase(str, "true") || equals_lowercase(str, "t");
+            }
+
+            template <typename T, typename S>
+            typename FB::meta::enable_for_numbers<T, T>::type
+            convert_value(const S& v, const type_spec<T>&) {
+                return to_number<T>(v, typename source_kind<S>::type());
+            }
+            template <typename S>
+            bool convert_value(const S& v, const type_spec<bool>&) {
+                return to_bool(v, typename source_kind<S>::type());
+            }
+
+            template <typename T>
+            struct converter
+            {
+                typedef T (*entry)(const variant&);
+                static const entry table[type_tag_count];
+
+                static T convert(const variant& var) {
+                    return table[static_cast<std::size_t>(var.get_type_tag())](var);
+                }
+
+                static T from_none(const variant& var) {
+                    throw bad_variant_cast(var.get_type(), typeid(T));
+                }
+                static T from_unknown(const variant& var) {
+                    if (var.get_type() == typeid(T)) {
+                        return var.unchecked_cast<T>();
+                    }
+                    return from_unknown(var, std::is_same<T, bool>());
+                }
+                template <typename S>
+                static T from(const variant& var) {
+                    return convert_value(var.unchecked_cast<S>(), type_spec<T>());
+                }
+
+            private:
+                static T from_unknown(const variant& var, std::false_type) {
+                    throw bad_variant_cast(var.get_type(), typeid(T));
+                }
+                static T from_unknown(const variant& var, std::true_type) {
+                    // bool falls back to the conversion to long
+                    return converter<long>::from_unknown(var) != 0;
+                }
+            };
+
+            // Same as converter, but for std::string / std::wstring and appending to an
+            // existing string
+            template <typename Str>
+            struct string_appender
+            {
+                typedef void (*entry)(const variant&, Str&);
+                static const entry table[type_tag_count];
+
+                static void append(const variant& var, Str& out) {
+                    table[static_cast<std::size_t>(var.get_type_tag())](var, out);
+                }
+
+                static void from_none(const variant& var, Str&) {
+                    throw bad_variant_cast(var.get_type(), typeid(Str));
+                }
+                static void from_unknown(const variant& var, Str& out) {
+                    if (var.get_type() != typeid(Str)) {
+                        throw bad_variant_cast(var.get_type(), typeid(Str));
+                    }
+                    out += var.unchecked_cast<Str>();
+                }
+                template <typename S>
+                static void from(const variant& var, Str& out) {
+                    append_string(out, var.unchecked_cast<S>(), typename source_kind<S>::type());
+                }
+            };
+
+#define FB_VARIANT_CONVERTER_ENTRY(_tag_, _type_) &converter<T>::template from< _type_ >,
+            template <typename T>
+            const typename converter<T>::entry converter<T>::table[type_tag_count] = {
+                &converter<T>::from_none,
+                &converter<T>::from_unknown,
+                FB_VARIANT_KNOWN_TYPES(FB_VARIANT_CONVERTER_ENTRY)
+            };
+#undef FB_VARIANT_CONVERTER_ENTRY
+
+#define FB_VARIANT_APPENDER_ENTRY(_tag_, _type_) &string_appender<Str>::template from< _type_ >,
+            template <typename Str>
+            const typename string_appender<Str>::entry string_appender<Str>::table[type_tag_count] = {
+                &string_appender<Str>::from_none,
+                &string_appender<Str>::from_unknown,
+                FB_VARIANT_KNOWN_TYPES(FB_VARIANT_APPENDER_ENTRY)
+            };
+#undef FB_VARIANT_APPENDER_ENTRY
+        }
+    }
+
+    namespace variant_detail {
+        template <typename F, typename Arg>
+        struct is_callable_with {
+            template <typename U>
+            static FB::meta::detail::yes test(decltype(std::declval<U&>()(std::declval<const Arg&>()))*);
+            template <typename U>
+            static FB::meta::detail::no test(...);
+            static const bool value = sizeof(test<F>(nullptr)) == sizeof(FB::meta::detail::yes);
+        };
+
+        ///////////////////////////////////////////////////
+        // variant::visit dispatch table
+        //
+        // One entry per type_tag, instantiated for each
+        // visitor type, so a visit is a single indexed
+        // call no matter which type is stored.
+        ///////////////////////////////////////////////////
+        template <typename Visitor, typename R>
+        struct visit_table
+        {
+            typedef R (*entry)(Visitor&, const variant&);
+            static const entry table[type_tag_count];
+
+            template <typename Arg>
+            static R call(Visitor& vis, const Arg& value) {
+                static_assert(is_callable_with<Visitor, Arg>::value,
+                    "variant::visit: the visitor must accept every type in FB_VARIANT_KNOWN_TYPES and FB::FBUnknownType");
+                return call(vis, value, std::integral_constant<bool, is_callable_with<Visitor, Arg>::value>());
+            }
+            template <typename Arg>
+            static R call(Visitor& vis, const Arg& value, std::true_type) {
+                return static_cast<R>(vis(value));
+            }
+            template <typename Arg>
+            static R call(Visitor&, const Arg&, std::false_type) {
+                throw bad_variant_cast(typeid(Arg), typeid(Visitor));
+            }
+
+            static R visit_none(Visitor& vis, const variant&) {
+                return call(vis, FB::FBVoid());
+            }
+            static R visit_unknown(Visitor& vis, const variant& var) {
+                FBUnknownType unknown = { var.get_type(), var };
+                return call(vis, unknown);
+            }
+            template <typename S>
+            static R visit(Visitor& vis, const variant& var) {
+                return call(vis, var.unchecked_cast<S>());
+            }
+        };
+
+#define FB_VARIANT_VISIT_ENTRY(_tag_, _type_) &visit_table<Visitor, R>::template visit< _type_ >,
+        template <typename Visitor, typename R>
+        const typename visit_table<Visitor, R>::entry visit_table<Visitor, R>::table[type_tag_count] = {
+            &visit_table<Visitor, R>::visit_none,
+            &visit_table<Visitor, R>::visit_unknown,
+            FB_VARIANT_KNOWN_TYPES(FB_VARIANT_VISIT_ENTRY)
+        };
+#undef FB_VARIANT_VISIT_ENTRY
+    }
+
+    template<typename Visitor>
+    typename variant_detail::visit_result<Visitor>::type
+    variant::visit(Visitor&& vis) const {
+        typedef typename std::remove_reference<Visitor>::type visitor_type;
+        typedef typename variant_detail::visit_result<Visitor>::type result_type;
+        return variant_detail::visit_table<visitor_type, result_type>::table[static_cast<std::size_t>(get_type_tag())](vis, *this);
+    }
+
+    inline void variant::append_to(std::string& out) const {
+        variant_detail::conversion::string_appender<std::string>::append(*this, out);
+    }
+
+    inline void variant::append_to(std::wstring& out) const {
+        variant_detail::conversion::string_appender<std::wstring>::append(*this, out);
+    }
+
+    inline void variant::convert_to(std::string& out) const {
+        out.clear();
+        append_to(out);
+    }
+
+    inline void variant::convert_to(std::wstring& out) const {
+        out.clear();
+        append_to(out);
+    }
+
     template <>
     inline const std::string variant::convert_cast<std::string>() const {
-        variant var = *this;
-        FB_BEGIN_CONVERT_MAP(std::string);
-        FB_CONVERT_ENTRY_TO_STRING(double);
-        FB_CONVERT_ENTRY_TO_STRING(float);
-        FB_CONVERT_ENTRY_TO_STRING(int);
-        FB_CONVERT_ENTRY_TO_STRING(unsigned int);
-        FB_CONVERT_ENTRY_COMPLEX_BEGIN(bool, bval);
-        return bval ? "true" : "false";
-        FB_CONVERT_ENTRY_COMPLEX_END();
-        FB_CONVERT_ENTRY_COMPLEX_BEGIN(std::wstring, str);
-        return wstring_to_utf8(str);
-        FB_CONVERT_ENTRY_COMPLEX_END();
-        FB_CONVERT_ENTRY_TO_STRING(long);
-        FB_CONVERT_ENTRY_TO_STRING(unsigned long);
-        FB_CONVERT_ENTRY_TO_STRING(short);
-        FB_CONVERT_ENTRY_TO_STRING(unsigned short);
-        FB_CONVERT_ENTRY_TO_STRING(char);
-        FB_CONVERT_ENTRY_TO_STRING(unsigned char);
-        FB_CONVERT_ENTRY_TO_STRING(boost::int64_t);
-        FB_CONVERT_ENTRY_TO_STRING(boost::uint64_t);
-        FB_END_CONVERT_MAP(std::string);
+        std::string out;
+        append_to(out);
+        return out;
     }
 
     template<>
     inline const std::wstring variant::convert_cast<std::wstring>() const {
-        variant var = *this;
-        FB_BEGIN_CONVERT_MAP(std::wstring);
-        FB_CONVERT_ENTRY_TO_WSTRING(double);
-        FB_CONVERT_ENTRY_TO_WSTRING(float);
-        FB_CONVERT_ENTRY_TO_WSTRING(int);
-        FB_CONVERT_ENTRY_TO_WSTRING(unsigned int);
-        FB_CONVERT_ENTRY_COMPLEX_BEGIN(bool, bval);
-        return bval ? L"true" : L"false";
-        FB_CONVERT_ENTRY_COMPLEX_END();
-        FB_CONVERT_ENTRY_COMPLEX_BEGIN(std::string, str);
-        return utf8_to_wstring(str);
-        FB_CONVERT_ENTRY_COMPLEX_END();
-        FB_CONVERT_ENTRY_TO_WSTRING(long);
-        FB_CONVERT_ENTRY_TO_WSTRING(unsigned long);
-        FB_CONVERT_ENTRY_TO_WSTRING(short);
-        FB_CONVERT_ENTRY_TO_WSTRING(unsigned short);
-        FB_CONVERT_ENTRY_TO_WSTRING(char);
-        FB_CONVERT_ENTRY_TO_WSTRING(unsigned char);
-        FB_END_CONVERT_MAP(std::wstring);
+        std::wstring out;
+        append_to(out);
+        return out;
     }
     
     template<>
     inline const bool variant::convert_cast<bool>() const {
-        variant var = *this;
-        FB_BEGIN_CONVERT_MAP(bool);
-        FB_CONVERT_ENTRY_COMPLEX_BEGIN(std::string, str);
-        std::transform(str.begin(), str.end(), str.begin(), ::tolower); 
-        return (str == "y" || str == "1" || str == "yes" || str == "true" || str == "t");
-        FB_CONVERT_ENTRY_COMPLEX_END();
-        FB_CONVERT_ENTRY_COMPLEX_BEGIN(std::wstring, str);
-        std::transform(str.begin(), str.end(), str.begin(), ::tolower); 
-        return (str == L"y" || str == L"1" || str == L"yes" || str == L"true" || str == L"t");
-        FB_CONVERT_ENTRY_COMPLEX_END();
-        FB_END_CONVERT_MAP_NO_THROW(short);
-        
-        return convert_cast<long>();
+        return variant_detail::conversion::converter<bool>::convert(*this);
     }
 
     namespace variant_detail {
@@ -539,8 +1076,8 @@ namespace FB
             // std::string
             ///////////////////////////////////////////////////
             template <class T>
-            typename boost::enable_if<
-                boost::mpl::or_<
+            struct is_stored_as_is
+                : boost::mpl::or_<
                     boost::mpl::or_<
                         boost::mpl::or_<
                             boost::is_same<std::vector<variant>, T>,
@@ -555,11 +1092,21 @@ namespace FB
                         boost::is_same<variant_detail::empty, T>,
                         boost::is_same<variant_detail::null, T>
                     >
-                >, variant>::type
+                > {};
+
+            template <class T>
+            typename boost::enable_if<is_stored_as_is<T>, variant>::type
             make_variant(const T& t) {
                 return variant(t, true);
             }
 
+            // rvalues of the same types are moved in (T is only a plain type for rvalues)
+            template <class T>
+            typename boost::enable_if<is_stored_as_is<T>, variant>::type
+            make_variant(T&& t) {
+                return variant(std::move(t), true);
+            }
+
             template <class T>
             variant make_variant(const boost::optional<T>& val) {
                 if (val)
@@ -619,26 +1166,7 @@ namespace FB
             template<typename T>
             typename FB::meta::enable_for_numbers<T, T>::type
             convert_variant(const variant& var, const type_spec<T>&) {
-                FB_BEGIN_CONVERT_MAP(T)
-                FB_CONVERT_ENTRY_NUMERIC(T, char)
-                FB_CONVERT_ENTRY_NUMERIC(T, unsigned char)
-                FB_CONVERT_ENTRY_NUMERIC(T, short)
-                FB_CONVERT_ENTRY_NUMERIC(T, unsigned short)
-                FB_CONVERT_ENTRY_NUMERIC(T, int)
-                FB_CONVERT_ENTRY_NUMERIC(T, unsigned int)
-                FB_CONVERT_ENTRY_NUMERIC(T, long)
-                FB_CONVERT_ENTRY_NUMERIC(T, unsigned long)
-                FB_CONVERT_ENTRY_NUMERIC(T, long long)
-                FB_CONVERT_ENTRY_NUMERIC(T, unsigned long long)
-                FB_CONVERT_ENTRY_NUMERIC(T, float)
-                FB_CONVERT_ENTRY_NUMERIC(T, double)
-                FB_CONVERT_ENTRY_COMPLEX_BEGIN(bool, bval);
-                    // we handle bool here specifically because the numeric_cast produces warnings
-                    return static_cast<T>(bval ? 1 : 0);
-                FB_CONVERT_ENTRY_COMPLEX_END();
-                FB_CONVERT_ENTRY_FROM_STRING(T, std::string)
-                FB_CONVERT_ENTRY_FROM_WSTRING(T, std::wstring)
-                FB_END_CONVERT_MAP(T)
+                return converter<T>::convert(var);
             }
         }
     }
@@ -655,31 +1183,332 @@ namespace FB
         return variant_detail::conversion::convert_variant(*this, variant_detail::conversion::type_spec<T>());
     }
 
+    template<typename T>
+    typename FB::meta::disable_for_containers<T, void>::type
+    variant::convert_to(T& out) const
+    {
+        if (is_of_type<T>()) {
+            // copy assignment lets out keep its storage
+            out = unchecked_cast<T>();
+        } else {
+            out = convert_cast<T>();
+        }
+    }
+
+    namespace variant_detail {
+        ///////////////////////////////////////////////////
+        // variant equality, ordering and hashing
+        //
+        // Numbers are first reduced to a number_key, which
+        // is the same for every representation of one
+        // value, so that e.g. 2, 2u and 2.0 are equal,
+        // equivalent under < and hash alike.  Everything
+        // else is compared per type with equalto<T> and
+        // lessthan<T>.
+        ///////////////////////////////////////////////////
+        struct number_key {
+            enum kind_type { negative_integer, nonnegative_integer, real };
+
+            kind_type kind;
+            unsigned long long bits;    // integers
+            double value;               // reals (never a whole number that fits in 64 bits)
+
+            static number_key from_integer(long long v) {
+                if (v >= 0) {
+                    return from_integer(static_cast<unsigned long long>(v));
+                }
+                number_key key = { negative_integer, static_cast<unsigned long long>(v), 0 };
+                return key;
+            }
+            static number_key from_integer(unsigned long long v) {
+                number_key key = { nonnegative_integer, v, 0 };
+                return key;
+            }
+            static number_key from_real(double v) {
+                // whole numbers in range become integers so that 2.0 == 2 (and -0.0 == 0)
+                if (v == std::floor(v)) {
+                    if (v >= 0 && v < 18446744073709551616.0) {
+                        return from_integer(static_cast<unsigned long long>(v));
+                    }
+                    if (v < 0 && v >= -9223372036854775808.0) {
+                        return from_integer(static_cast<long long>(v));
+                    }
+                }
+                number_key key = { real, 0, v };
+                return key;
+            }
+
+            bool operator==(const number_key& rh) const {
+                if (kind != rh.kind) {
+                    return false;
+                }
+                if (kind != real) {
+                    return bits == rh.bits;
+                }
+                return value == rh.value || (value != value && rh.value != rh.value);
+            }
+
+            // Orders by value, with every NaN after all other numbers; consistent with operator==
+            bool operator<(const number_key& rh) const {
+                if (kind != real && rh.kind != real) {
+                    if (kind != rh.kind) {
+                        return kind == negative_integer;
+                    }
+                    return kind == negative_integer
+                        ? static_cast<long long>(bits) < static_cast<long long>(rh.bits)
+                        : bits < rh.bits;
+                }
+                if (kind == real && rh.kind == real) {
+                    if (rh.value != rh.value) {
+                        return value == value;
+                    }
+                    return value < rh.value;
+                }
+                // a real never equals an integer, so exactly one of them is below the other
+                return kind == real ? real_below(value, rh) : !real_below(rh.value, *this);
+            }
+
+            std::size_t hash() const {
+                if (kind != real) {
+                    return std::hash<unsigned long long>()(bits);
+                }
+                return value != value ? 0 : std::hash<double>()(value);
+            }
+
+        private:
+            // True if the real v is less than the integer key i
+            static bool real_below(double v, const number_key& i) {
+                if (v != v) {
+                    return false;
+                }
+                const double whole = std::floor(v);
+                if (whole != v) {
+                    // not a whole number, so |v| < 2^52 and its floor fits; v < i exactly when floor(v) < i
+                    const long long f = static_cast<long long>(whole);
+                    return i.kind == negative_integer
+                        ? f < static_cast<long long>(i.bits)
+                        : f < 0 || static_cast<unsigned long long>(f) < i.bits;
+                }
+                // a whole real is out of the range of the integers (or infinite)
+                return v < 0;
+            }
+        };
+
+        // Returns false if s does not hold one of the numeric types (see variant::operator==)
+        inline bool get_number_key(const storage& s, number_key& key) {
+            switch (s.tag()) {
+            case type_tag::short_type:      key = number_key::from_integer(static_cast<long long>(s.cast<short>())); return true;
+            case type_tag::ushort_type:     key = number_key::from_integer(static_cast<unsigned long long>(s.cast<unsigned short>())); return true;
+            case type_tag::int_type:        key = number_key::from_integer(static_cast<long long>(s.cast<int>())); return true;
+            case type_tag::uint_type:       key = number_key::from_integer(static_cast<unsigned long long>(s.cast<unsigned int>())); return true;
+            case type_tag::long_type:       key = number_key::from_integer(static_cast<long long>(s.cast<long>())); return true;
+            case type_tag::ulong_type:      key = number_key::from_integer(static_cast<unsigned long long>(s.cast<unsigned long>())); return true;
+            case type_tag::longlong_type:   key = number_key::from_integer(s.cast<long long>()); return true;
+            case type_tag::ulonglong_type:  key = number_key::from_integer(s.cast<unsigned long long>()); return true;
+            case type_tag::float_type:      key = number_key::from_real(s.cast<float>()); return true;
+            case type_tag::double_type:     key = number_key::from_real(s.cast<double>()); return true;
+            default:                        return false;
+            }
+        }
+
+        template<typename T>
+        struct equalto {
+            static bool impl(const storage& l, const storage& r) {
+                return l.cast<T>() == r.cast<T>();
+            }
+            static std::size_t hash(const storage& s) {
+                return std::hash<T>()(s.cast<T>());
+            }
+        };
+
+        // All values of these types are alike; an empty storage is compared as FBVoid too, so
+        // these must not look at the value
+        template<>
+        struct equalto < FB::FBVoid > {
+            static bool impl(const storage&, const storage&) {
+                return true;
+            }
+            static std::size_t hash(const storage&) {
+                return 0;
+            }
+        };
+
+        template<>
+        struct equalto < FB::FBNull > {
+            static bool impl(const storage&, const storage&) {
+                return true;
+            }
+            static std::size_t hash(const storage&) {
+                return 0;
+            }
+        };
+
+        template<>
+        struct equalto < std::exception_ptr > {
+            static bool impl(const storage& l, const storage& r) {
+                return l.cast<std::exception_ptr>() == r.cast<std::exception_ptr>();
+            }
+            static std::size_t hash(const storage&) {
+                return 0;
+            }
+        };
+
+        template<>
+        struct equalto < variant_list > {
+            static bool impl(const storage& l, const storage& r) {
+                return l.cast<variant_list>() == r.cast<variant_list>();
+            }
+            static std::size_t hash(const storage& s) {
+                const variant_list& list = s.cast<variant_list>();
+                std::size_t seed = list.size();
+                for (const variant& v : list) {
+                    boost::hash_combine(seed, v.hash());
+                }
+                return seed;
+            }
+        };
+
+        template<>
+        struct equalto < variant_map > {
+            static bool impl(const storage& l, const storage& r) {
+                return l.cast<variant_map>() == r.cast<variant_map>();
+            }
+            static std::size_t hash(const storage& s) {
+                const variant_map& map = s.cast<variant_map>();
+                std::size_t seed = map.size();
+                for (const auto& entry : map) {
+                    boost::hash_combine(seed, std::hash<std::string>()(entry.first));
+                    boost::hash_combine(seed, entry.second.hash());
+                }
+                return seed;
+            }
+        };
+
+        struct comparison {
+            static type_tag tag_of(const storage& s) {
+                return s.tag() == type_tag::none ? type_tag::void_type : s.tag();
+            }
+
+            static bool equal(const variant& lv, const variant& rv) {
+                const storage& l = lv.object;
+                const storage& r = rv.object;
+                number_key lkey, rkey;
+                if (get_number_key(l, lkey)) {
+                    return get_number_key(r, rkey) && lkey == rkey;
+                }
+                const type_tag tag = tag_of(l);
+                if (tag != tag_of(r)) {
+                    return false;
+                }
+                switch (tag) {
+#define FB_VARIANT_EQUAL_CASE(_tag_, _type_) \
+                case type_tag::_tag_: \
+                    return equalto< _type_ >::impl(l, r);
+                FB_VARIANT_KNOWN_TYPES(FB_VARIANT_EQUAL_CASE)
+#undef FB_VARIANT_EQUAL_CASE
+                default:
+                    return l.type() == r.type() && !l.less(r) && !r.less(l);
+                }
+            }
+
+            static bool less(const variant& lv, const variant& rv) {
+                const storage& l = lv.object;
+                const storage& r = rv.object;
+                number_key lkey, rkey;
+                const bool lnumber = get_number_key(l, lkey);
+                const bool rnumber = get_number_key(r, rkey);
+                if (lnumber && rnumber) {
+                    return lkey < rkey;
+                }
+                const type_tag tag = tag_of(l);
+                if (tag != tag_of(r)) {
+                    return type_rank(tag) < type_rank(tag_of(r));
+                }
+                switch (tag) {
+#define FB_VARIANT_LESS_CASE(_tag_, _type_) \
+                case type_tag::_tag_: \
+                    return lessthan< _type_ >::impl(l, r);
+                FB_VARIANT_KNOWN_TYPES(FB_VARIANT_LESS_CASE)
+#undef FB_VARIANT_LESS_CASE
+                default:
+                    if (l.type() == r.type()) {
+                        return l.less(r);
+                    }
+                    return strcmp(l.type().name(), r.type().name()) < 0;
+                }
+            }
+
+            static std::size_t hash(const variant& v) {
+                const storage& s = v.object;
+                number_key key;
+                if (get_number_key(s, key)) {
+                    return key.hash();
+                }
+                const type_tag tag = tag_of(s);
+                std::size_t seed = static_cast<std::size_t>(tag);
+                switch (tag) {
+#define FB_VARIANT_HASH_CASE(_tag_, _type_) \
+                case type_tag::_tag_: \
+                    boost::hash_combine(seed, equalto< _type_ >::hash(s)); \
+                    break;
+                FB_VARIANT_KNOWN_TYPES(FB_VARIANT_HASH_CASE)
+#undef FB_VARIANT_HASH_CASE
+                default:
+                    // values of unknown types can't be hashed; equal ones still share their type
+                    boost::hash_combine(seed, s.type().hash_code());
+                    break;
+                }
+                return seed;
+            }
+        };
+    }
+
+    inline bool variant::operator<(const variant& rh) const {
+        return variant_detail::comparison::less(*this, rh);
+    }
+
+    inline bool variant::operator==(const variant& rh) const {
+        return variant_detail::comparison::equal(*this, rh);
+    }
+
+    inline std::size_t variant::hash() const {
+        return variant_detail::comparison::hash(*this);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @struct VariantHash
+    ///
+    /// @brief  Hash function object for FB::variant, see variant::operator== and variant::hash()
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    struct VariantHash {
+        std::size_t operator()(const variant& v) const {
+            return v.hash();
+        }
+    };
+
     template <class T>
-    variant make_variant(T t)
+    variant make_variant(T&& t)
     {
         // If you got an error on this line, you are trying to assign an unsupported type to 
         // FB::variant! If you're certain you want to do this then you should use the constructor
         // or assign method that takes a bool.  e.g.: variant tmp(myWeirdType, true);
-        return variant_detail::conversion::make_variant(t);
+        return variant_detail::conversion::make_variant(std::forward<T>(t));
     }
+
+    inline void swap(variant& a, variant& b) noexcept {
+        a.swap(b);
+    }
+}
+
+namespace std {
+    template<>
+    struct hash<FB::variant> : FB::VariantHash {};
 }
 
 #ifdef _WIN32
 #pragma warning(pop)
 #endif
 
-#undef FB_BEGIN_CONVERT_MAP
-#undef FB_END_CONVERT_MAP
-#undef FB_END_CONVERT_MAP_NO_THROW
-#undef FB_CONVERT_ENTRY_SIMPLE
-#undef FB_CONVERT_ENTRY_NUMERIC
-#undef FB_CONVERT_ENTRY_TO_STRING
-#undef FB_CONVERT_ENTRY_TO_WSTRING
-#undef FB_CONVERT_ENTRY_FROM_STRING
-#undef FB_CONVERT_ENTRY_FROM_STRING_TYPE
-#undef FB_CONVERT_ENTRY_COMPLEX_BEGIN
-#undef FB_CONVERT_ENTRY_COMPLEX_END
 
 #endif // FB_VARIANT_H
 
@@ -0,0 +1,350 @@
+/**********************************************************\
+Created:    Oct 15, 2026
+License:    Dual license model; choose one of two:
+            New BSD License
+            http://www.opensource.org/licenses/bsd-license.php
+            - or -
+            GNU Lesser General Public License, version 2.1
+            http://www.gnu.org/licenses/lgpl-2.1.html
+
+Copyright 2026 Firebreath development team
+\**********************************************************/
+
+#pragma once
+#ifndef H_FB_VARIANT_STORAGE
+#define H_FB_VARIANT_STORAGE
+
+#include <cstddef>
+#include <exception>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+#include <typeinfo>
+#include <type_traits>
+#include <utility>
+
+namespace FB {
+    class variant;
+    struct FBNull;
+    namespace variant_detail {
+        struct empty;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @def    FB_VARIANT_KNOWN_TYPES
+///
+/// @brief  Invokes _entry_(tag, type) for every type that gets its own FB::variant_detail::type_tag.
+///         The order here is the order of the tags.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#define FB_VARIANT_KNOWN_TYPES(_entry_) \
+    _entry_(void_type,          FB::variant_detail::empty) \
+    _entry_(null_type,          FB::FBNull) \
+    _entry_(bool_type,          bool) \
+    _entry_(char_type,          char) \
+    _entry_(uchar_type,         unsigned char) \
+    _entry_(short_type,         short) \
+    _entry_(ushort_type,        unsigned short) \
+    _entry_(int_type,           int) \
+    _entry_(uint_type,          unsigned int) \
+    _entry_(long_type,          long) \
+    _entry_(ulong_type,         unsigned long) \
+    _entry_(longlong_type,      long long) \
+    _entry_(ulonglong_type,     unsigned long long) \
+    _entry_(float_type,         float) \
+    _entry_(double_type,        double) \
+    _entry_(string_type,        std::string) \
+    _entry_(wstring_type,       std::wstring) \
+    _entry_(list_type,          FB::variant_detail::variant_list) \
+    _entry_(map_type,           FB::variant_detail::variant_map) \
+    _entry_(exception_ptr_type, std::exception_ptr)
+
+namespace FB { namespace variant_detail {
+
+    // Same as FB::VariantList / FB::VariantMap; spelled out so this header doesn't need APITypes.h
+    typedef std::vector<variant> variant_list;
+    typedef std::map<std::string, variant> variant_map;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @enum   type_tag
+    ///
+    /// @brief  Compact identifier of the type stored in a variant.  Every type in
+    ///         FB_VARIANT_KNOWN_TYPES has its own tag; anything else is type_tag::other.
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    enum class type_tag : unsigned char {
+        none,   // nothing stored
+        other,  // a type not listed in FB_VARIANT_KNOWN_TYPES
+#define FB_VARIANT_TAG_ENUM(_tag_, _type_) _tag_,
+        FB_VARIANT_KNOWN_TYPES(FB_VARIANT_TAG_ENUM)
+#undef FB_VARIANT_TAG_ENUM
+        count
+    };
+
+    static const std::size_t type_tag_count = static_cast<std::size_t>(type_tag::count);
+
+    /// @brief  Gives the type_tag of T
+    template <typename T>
+    struct type_tag_of
+        : std::integral_constant<type_tag, type_tag::other> {};
+
+    /// @brief  Gives the type for a type_tag (the reverse of type_tag_of)
+    template <type_tag Tag>
+    struct tag_type;
+
+#define FB_VARIANT_TAG_TRAITS(_tag_, _type_) \
+    template <> \
+    struct type_tag_of< _type_ > \
+        : std::integral_constant<type_tag, type_tag::_tag_> {}; \
+    template <> \
+    struct tag_type< type_tag::_tag_ > { \
+        typedef _type_ type; \
+    };
+    FB_VARIANT_KNOWN_TYPES(FB_VARIANT_TAG_TRAITS)
+#undef FB_VARIANT_TAG_TRAITS
+
+    class storage;
+    template <typename T>
+    struct storage_impl;
+
+    // Strict weak ordering of two stored values of type T; defined (and specialized) in variant.h
+    template <typename T>
+    struct lessthan;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @struct storage_ops
+    ///
+    /// @brief  Table of operations for one stored type; there is exactly one instance per type
+    ///         and FB::variant_detail::storage keeps a pointer to it next to the payload
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    struct storage_ops {
+        const std::type_info& (*type)();
+        void (*copy)(const storage& src, storage& dst);
+        void (*move)(storage& src, storage& dst);
+        void (*destroy)(storage& s);
+        bool (*less)(const storage& l, const storage& r);
+    };
+
+    template <std::size_t A, std::size_t B>
+    struct static_max : std::integral_constant<std::size_t, (A > B ? A : B)> {};
+
+    // Large enough for every arithmetic type, FBNull/FBVoid and the string types themselves (so
+    // short strings are kept in place by the string's own small buffer).  The alignment is kept
+    // to that of double/pointers so the variant stays small; over-aligned types are boxed.
+    static const std::size_t storage_size =
+        static_max<static_max<sizeof(std::string), sizeof(std::wstring)>::value, sizeof(long double)>::value;
+    static const std::size_t storage_align =
+        static_max<static_max<std::alignment_of<double>::value, std::alignment_of<long long>::value>::value,
+                   std::alignment_of<void*>::value>::value;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @struct is_stored_inline
+    ///
+    /// @brief  True if T is kept in the small buffer of FB::variant_detail::storage; all other types
+    ///         are boxed on the heap.  Types must be nothrow movable to be kept in place so that
+    ///         moving storage around can never throw.
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    template <typename T>
+    struct is_stored_inline
+        : std::integral_constant<bool,
+            sizeof(T) <= storage_size &&
+            storage_align % std::alignment_of<T>::value == 0 &&
+            std::is_nothrow_move_constructible<T>::value> {};
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @class  storage
+    ///
+    /// @brief  Type erased value holder used by FB::variant in place of boost::any.
+    ///
+    /// Values which fit (see is_stored_inline) are constructed directly in an internal buffer;
+    /// anything else is allocated on the heap and only the pointer is kept in the buffer.  The
+    /// caller is responsible for checking type() before calling cast<T>().
+    ////////////////////////////////////////////////////////////////////////////////////////////////////
+    class storage
+    {
+    public:
+        storage() : m_ops(nullptr), m_tag(type_tag::none) { }
+        storage(const storage& rh) : m_ops(nullptr), m_tag(type_tag::none) {
+            if (rh.m_ops) {
+                rh.m_ops->copy(rh, *this);
+                m_ops = rh.m_ops;
+                m_tag = rh.m_tag;
+            }
+        }
+        storage(storage&& rh) noexcept : m_ops(nullptr), m_tag(type_tag::none) {
+            rh.move_to(*this);
+        }
+        ~storage() {
+            clear();
+        }
+
+        storage& operator=(const storage& rh) {
+            if (this != &rh) {
+                storage tmp(rh);
+                swap(tmp);
+            }
+            return *this;
+        }
+        storage& operator=(storage&& rh) noexcept {
+            if (this != &rh) {
+                // rh may live inside the current value (an element of a list held here), so take
+                // it out before that value is destroyed
+                storage tmp(std::move(rh));
+                swap(tmp);
+            }
+            return *this;
+        }
+
+        template <typename T>
+        void assign(T&& x) {
+            storage tmp;
+            tmp.construct<typename std::decay<T>::type>(std::forward<T>(x));
+            swap(tmp);
+        }
+
+        // Constructs a T from args and makes it the value; args may refer to the current value
+        // (or something inside it), which is only destroyed once the new one exists
+        template <typename T, typename... Args>
+        T& emplace(Args&&... args) {
+            storage tmp;
+            tmp.construct<T>(std::forward<Args>(args)...);
+            swap(tmp);
+            return cast<T>();
+        }
+
+        void swap(storage& rh) noexcept {
+            if (this == &rh) {
+                return;
+            }
+            storage tmp;
+            move_to(tmp);
+            rh.move_to(*this);
+            tmp.move_to(rh);
+        }
+
+        void clear() {
+            if (m_ops) {
+                m_ops->destroy(*this);
+                m_ops = nullptr;
+                m_tag = type_tag::none;
+            }
+        }
+
+        bool empty() const {
+            return !m_ops;
+        }
+
+        const std::type_info& type() const {
+            return m_ops ? m_ops->type() : typeid(void);
+        }
+
+        type_tag tag() const {
+            return m_tag;
+        }
+
+        // Orders two values of the same type; the caller must check that type() matches first
+        bool less(const storage& rh) const {
+            return m_ops ? m_ops->less(*this, rh) : false;
+        }
+
+        template <typename T>
+        const T& cast() const {
+            return *static_cast<const T*>(address<T>(is_stored_inline<T>()));
+        }
+        template <typename T>
+        T& cast() {
+            return *static_cast<T*>(const_cast<void*>(address<T>(is_stored_inline<T>())));
+        }
+
+    private:
+        template <typename T>
+        friend struct storage_impl;
+
+        template <typename T, typename... Args>
+        void construct(Args&&... args) {
+            construct_impl<T>(is_stored_inline<T>(), std::forward<Args>(args)...);
+            m_ops = &storage_impl<T>::ops;
+            m_tag = type_tag_of<T>::value;
+        }
+        template <typename T, typename... Args>
+        void construct_impl(std::true_type, Args&&... args) {
+            new (&m_buf) T(std::forward<Args>(args)...);
+        }
+        template <typename T, typename... Args>
+        void construct_impl(std::false_type, Args&&... args) {
+            m_ptr = new T(std::forward<Args>(args)...);
+        }
+
+        template <typename T>
+        const void* address(std::true_type) const {
+            return &m_buf;
+        }
+        template <typename T>
+        const void* address(std::false_type) const {
+            return m_ptr;
+        }
+
+        // Moves the value into dst, which must be empty; leaves *this empty
+        void move_to(storage& dst) noexcept {
+            if (m_ops) {
+                m_ops->move(*this, dst);
+                dst.m_ops = m_ops;
+                dst.m_tag = m_tag;
+                m_ops = nullptr;
+                m_tag = type_tag::none;
+            }
+        }
+
+        union {
+            void* m_ptr;
+            typename std::aligned_storage<storage_size, storage_align>::type m_buf;
+        };
+        const storage_ops* m_ops;
+        type_tag m_tag;
+    };
+
+    template <typename T>
+    struct storage_impl
+    {
+        static const storage_ops ops;
+
+        static const std::type_info& type() {
+            return typeid(T);
+        }
+        static void copy(const storage& src, storage& dst) {
+            dst.construct_impl<T>(is_stored_inline<T>(), src.cast<T>());
+        }
+        static void move(storage& src, storage& dst) {
+            move(src, dst, is_stored_inline<T>());
+        }
+        static void move(storage& src, storage& dst, std::true_type) {
+            T& val = *reinterpret_cast<T*>(&src.m_buf);
+            new (&dst.m_buf) T(std::move(val));
+            val.~T();
+        }
+        static void move(storage& src, storage& dst, std::false_type) {
+            dst.m_ptr = src.m_ptr;
+        }
+        static void destroy(storage& s) {
+            destroy(s, is_stored_inline<T>());
+        }
+        static void destroy(storage& s, std::true_type) {
+            reinterpret_cast<T*>(&s.m_buf)->~T();
+        }
+        static void destroy(storage& s, std::false_type) {
+            delete static_cast<T*>(s.m_ptr);
+        }
+    };
+
+    template <typename T>
+    const storage_ops storage_impl<T>::ops = {
+        &storage_impl<T>::type,
+        &storage_impl<T>::copy,
+        &storage_impl<T>::move,
+        &storage_impl<T>::destroy,
+        &lessthan<T>::impl
+    };
+
+} }
+
+#endif // H_FB_VARIANT_STORAGE